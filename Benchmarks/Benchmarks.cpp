@@ -0,0 +1,304 @@
+#include "benchmark/benchmark.h"
+#include "Renderer.hpp"
+#include "RedrawRegions.hpp"
+#include "RenderElement.hpp"
+#include "Stage.hpp"
+#include "FontManager.hpp"
+#include "RTree.h"
+#include "Utility.hpp"
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace flint;
+
+namespace
+{
+	const int SCREEN_WIDTH = 1920;
+	const int SCREEN_HEIGHT = 1080;
+
+	using RTree2D = RTree<char, int, 2, float, 8, 1>;
+
+	// Exposes the dirty flags so every iteration recomputes from scratch.
+	class Element : public IRenderElement
+	{
+	public:
+
+		explicit Element(Renderer& renderer) : IRenderElement(renderer)
+		{
+			m_nOverFlow = OverFlow::VISIBLE;
+		}
+
+		void dirty()
+		{
+			m_bBoundsDirty = true;
+			m_bTransformsDirty = true;
+		}
+	};
+
+	Renderer& getRenderer()
+	{
+		static Renderer renderer;
+		return renderer;
+	}
+
+	std::vector<Bound> makeBounds(size_t count, int maxSize, unsigned int seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_int_distribution<int> x(0, SCREEN_WIDTH - 1), y(0, SCREEN_HEIGHT - 1), size(1, maxSize);
+		std::vector<Bound> bounds(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const int left = x(random), top = y(random);
+			bounds[i] = Bound(left, top, left + size(random), top + size(random));
+		}
+		return bounds;
+	}
+
+	// Damage produced by a frame: scattered small widgets, a cluster around
+	// one animated area, or full width rows of a scrolling list.
+	enum Damage
+	{
+		SCATTERED = 0,
+		CLUSTERED,
+		ROWS
+	};
+
+	std::vector<Bound> makeDamage(Damage damage, size_t count)
+	{
+		switch (damage)
+		{
+		case CLUSTERED:
+		{
+			std::mt19937 random(7);
+			std::normal_distribution<float> x(600, 80), y(400, 80);
+			std::uniform_int_distribution<int> size(8, 64);
+			std::vector<Bound> bounds(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const int left = (int)x(random), top = (int)y(random);
+				bounds[i] = Bound(left, top, left + size(random), top + size(random));
+			}
+			return bounds;
+		}
+		case ROWS:
+		{
+			std::vector<Bound> bounds(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const int top = (int)(i * 24) % SCREEN_HEIGHT;
+				bounds[i] = Bound(0, top, SCREEN_WIDTH, top + 24);
+			}
+			return bounds;
+		}
+		default:
+			return makeBounds(count, 48, 3);
+		}
+	}
+
+	void buildTree(Renderer& renderer, IRenderElement* pParent, int depth, int fanout, std::vector<Element*>& elements)
+	{
+		if (depth == 0)
+			return;
+		for (int i = 0; i < fanout; ++i)
+		{
+			Element* pElement = new Element(renderer);
+			pElement->setSize(Size(64, 32));
+			pElement->setPosition(Position(4 * i, 8));
+			if (i & 1)
+				pElement->setRotation(15);
+			pParent->add(pElement);
+			elements.push_back(pElement);
+			buildTree(renderer, pElement, depth - 1, fanout, elements);
+		}
+	}
+}
+
+static void BM_RTreeInsert(benchmark::State& state)
+{
+	const std::vector<Bound> bounds = makeBounds((size_t)state.range(0), 64, 1);
+	for (auto _ : state)
+	{
+		RTree2D tree;
+		for (const Bound& b : bounds)
+		{
+			const int min[2] = { b.left, b.top };
+			const int max[2] = { b.right, b.bottom };
+			tree.Insert(min, max, 0);
+		}
+		benchmark::DoNotOptimize(tree.Count());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RTreeInsert)->Range(16, 4096);
+
+static void BM_RTreeSearch(benchmark::State& state)
+{
+	const std::vector<Bound> bounds = makeBounds((size_t)state.range(0), 64, 1);
+	const std::vector<Bound> queries = makeBounds(256, 200, 2);
+	RTree2D tree;
+	for (const Bound& b : bounds)
+	{
+		const int min[2] = { b.left, b.top };
+		const int max[2] = { b.right, b.bottom };
+		tree.Insert(min, max, 0);
+	}
+	size_t nQuery = 0;
+	for (auto _ : state)
+	{
+		const Bound& q = queries[nQuery++ % queries.size()];
+		const int min[2] = { q.left, q.top };
+		const int max[2] = { q.right, q.bottom };
+		benchmark::DoNotOptimize(tree.Search(min, max, [](const char&) { return true; }));
+	}
+}
+BENCHMARK(BM_RTreeSearch)->Range(16, 4096);
+
+static void BM_RTreeRemoveAll(benchmark::State& state)
+{
+	const std::vector<Bound> bounds = makeBounds((size_t)state.range(0), 64, 1);
+	RTree2D tree;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		for (const Bound& b : bounds)
+		{
+			const int min[2] = { b.left, b.top };
+			const int max[2] = { b.right, b.bottom };
+			tree.Insert(min, max, 0);
+		}
+		state.ResumeTiming();
+		tree.RemoveAll();
+	}
+}
+BENCHMARK(BM_RTreeRemoveAll)->Range(16, 4096);
+
+static void BM_RedrawRegionsAdd(benchmark::State& state)
+{
+	const std::vector<Bound> damage = makeDamage((Damage)state.range(0), (size_t)state.range(1));
+	RedrawRegions regions(getRenderer());
+	SkPath* pPath = nullptr;
+	regions.update(pPath);
+	for (auto _ : state)
+	{
+		for (const Bound& b : damage)
+			regions.add(b);
+		state.PauseTiming();
+		regions.update(pPath);
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_RedrawRegionsAdd)->ArgsProduct({ { SCATTERED, CLUSTERED, ROWS }, { 8, 64, 512 } });
+
+static void BM_RedrawRegionsUpdate(benchmark::State& state)
+{
+	const std::vector<Bound> damage = makeDamage((Damage)state.range(0), (size_t)state.range(1));
+	RedrawRegions regions(getRenderer());
+	SkPath* pPath = nullptr;
+	regions.update(pPath);
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		for (const Bound& b : damage)
+			regions.add(b);
+		state.ResumeTiming();
+		benchmark::DoNotOptimize(regions.update(pPath));
+	}
+	state.counters["regions"] = (double)regions.getCount();
+}
+BENCHMARK(BM_RedrawRegionsUpdate)->ArgsProduct({ { SCATTERED, CLUSTERED, ROWS }, { 8, 64, 512 } });
+
+// Arguments are depth and fanout, 12x2 is deep and 1x4096 is wide.
+static void BM_GlobalBounds(benchmark::State& state)
+{
+	Renderer& renderer = getRenderer();
+	Element* pRoot = new Element(renderer);
+	renderer.getStage()->add(pRoot);
+	std::vector<Element*> elements;
+	buildTree(renderer, pRoot, (int)state.range(0), (int)state.range(1), elements);
+	for (auto _ : state)
+	{
+		pRoot->dirty();
+		for (Element* pElement : elements)
+			pElement->dirty();
+		benchmark::DoNotOptimize(pRoot->getGlobalBounds());
+		for (Element* pElement : elements)
+			benchmark::DoNotOptimize(pElement->getGlobalBounds());
+	}
+	state.SetItemsProcessed(state.iterations() * (int64_t)elements.size());
+	for (auto itr = elements.rbegin(); itr != elements.rend(); ++itr)
+		delete *itr;
+	delete pRoot;
+}
+BENCHMARK(BM_GlobalBounds)->Args({ 12, 2 })->Args({ 32, 1 })->Args({ 1, 256 })->Args({ 1, 4096 })->Args({ 3, 16 });
+
+static void BM_BoundIntersect(benchmark::State& state)
+{
+	const std::vector<Bound> bounds = makeBounds(1024, 400, 4);
+	const Bound viewport(200, 100, 1400, 900);
+	for (auto _ : state)
+	{
+		int hits = 0;
+		Bound out;
+		for (const Bound& b : bounds)
+			hits += viewport.intersect(b, out);
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * 1024);
+}
+BENCHMARK(BM_BoundIntersect);
+
+static void BM_RectangleIntersection(benchmark::State& state)
+{
+	const std::vector<Bound> bounds = makeBounds(1024, 400, 4);
+	std::vector<Rectangle> rects;
+	for (const Bound& b : bounds)
+		rects.emplace_back(b.left, b.top, (Size::Type)(b.right - b.left), (Size::Type)(b.bottom - b.top));
+	const Rectangle viewport(200, 100, 1200, 800);
+	for (auto _ : state)
+	{
+		int hits = 0;
+		Rectangle out;
+		for (const Rectangle& rc : rects)
+			hits += viewport.intersection(rc, out);
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * 1024);
+}
+BENCHMARK(BM_RectangleIntersection);
+
+static void BM_FontManagerCreate(benchmark::State& state)
+{
+	static const char* const Families[] = { "Arial", "Segoe UI", "Courier New", "Verdana" };
+	FontManager fonts;
+	for (const char* family : Families)
+	{
+		for (unsigned short size = 10; size < 26; size += 2)
+			fonts.create(family, size);
+	}
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(fonts.create(Families[i & 3], (unsigned short)(10 + 2 * ((i >> 2) & 7))));
+		++i;
+	}
+}
+BENCHMARK(BM_FontManagerCreate);
+
+static void BM_CommandLineArguments(benchmark::State& state)
+{
+	static const char Line[] = "--debug --main=\"Scripts/Main.js\" --trace=trace.json --size=1280x720 --frames 600";
+	char buffer[sizeof(Line)];
+	for (auto _ : state)
+	{
+		memcpy(buffer, Line, sizeof(Line));
+		utility::CommandLineArguments options(buffer);
+		benchmark::DoNotOptimize(options.get("--main"));
+		benchmark::DoNotOptimize(options.has("--debug"));
+	}
+}
+BENCHMARK(BM_CommandLineArguments);
+
+BENCHMARK_MAIN();
@@ -46,13 +46,10 @@ export class Application
 		Application.__I = this;
 		this.processQueue = [];
 		this.__spares = [];
-		this.__timers = new Map();
 		this.__events = {};
-		this.__tid = 0;
+		this.__trace = __f_trace(0);
 		this.root = null;
-		const result = __f_init(args);
-		Application.__I.__title = result[2];
-		Application.__I.__state = result[3];
+		__f_init(args);
 	}
 	
 	load(_ptr)
@@ -66,23 +63,29 @@ export class Application
 	{
 		if(this.onupdate)
 			this.onupdate(delta);
+		const trace = this.__trace;
 		for (let i = 0; i !== this.processQueue.length; ++i)
 		{
 			const callback = this.processQueue[i];
 			if(callback)
-				callback(delta);
-		}
-		for (let [id, timer] of this.__timers) 
-		{
-			timer[3] += delta;
-			if(timer[3] >= timer[2])
 			{
-				timer[1]();
-				timer[3] %= timer[2];
-				if(timer[0] === 1)
-					this.__timers.delete(id);
+				if(trace)
+				{
+					__f_trace(1, callback.name || 'processQueue');
+					try
+					{
+						callback(delta);
+					}
+					finally
+					{
+						__f_trace(2);
+					}
+				}
+				else
+					callback(delta);
 			}
 		}
+		return !!this.onupdate || this.processQueue.length !== this.__spares.length;
 	}
 	
 	dispatch(event)
@@ -142,66 +145,137 @@ export class Application
 		this['on' + name] = (typeof callback === 'function') ? callback : null;
 	}
 
-	addTimer(type, cb, time)
+	static get title() { return __app.title; }
+	static set title(value) { __app.title = value; }
+	
+	static get state() { return __app.state; }
+	static set state(value) { __app.state = value; }
+	
+	// [width, height], set from an array or {width, height}.
+	static get size() { return __app.size; }
+	static set size(value) { __app.size = value; }
+	
+	// Counters and timings (milliseconds) of the last presented frame.
+	static get stats() { return __app.stats; }
+	
+	// Garbage collection pauses during script work, in idle time and
+	// elsewhere: {frame, idle, other, frameTime, idleTime, otherTime}.
+	static get gc() { return __app.gc; }
+	
+	// Milliseconds per tick for microtasks after the tick's first
+	// checkpoint, later checkpoints wait for the next tick. 0 for no limit.
+	static get microtaskBudget() { return __app.microtaskBudget; }
+	static set microtaskBudget(value) { __app.microtaskBudget = value; }
+	
+	// Profiles in the DevTools formats: profile.start(path) records a CPU
+	// profile, profile.start({cpu, heap}) CPU and sampled allocation
+	// profiles, written by profile.stop(). profile.snapshot(path) writes a
+	// heap snapshot.
+	static get profile() { return Profile; }
+	
+	// Shared command buffer, see Commands.
+	static get commands() 
 	{
-		const id = ++this.__tid;
-		this.__timers.set(id, [type, cb, 0.001*time, 0.0]);
-		return id;
+		const app = Application.__I;
+		if(!app.__commands)
+			app.__commands = new Commands();
+		return app.__commands;
 	}
 	
-	removeTimer(id)
+	static get() { return Application.__I; }
+	static quit() { __app.quit(); }
+	static close() { __app.close(); }
+}
+
+const Profile =
+{
+	start(options) { return __app.startProfile(options); },
+	stop() { return __app.stopProfile(); },
+	snapshot(path) { return __app.writeHeapSnapshot(path); }
+};
+
+export function Color(r, g, b, a)
+{
+	const alpha = (a === undefined) ? 255 : a & 0xFF;
+	return ((alpha & 0xFF) << 24) | ((r & 0xFF) << 16) | ((g & 0xFF) << 8) | ((b & 0xFF));
+};
+
+// Records element mutations into a buffer shared with the engine, which
+// applies them all at once before the next frame is rendered, or when
+// flush() is called. Setters called directly on elements take effect
+// immediately, so mixing both on one element may apply out of order.
+export class Commands
+{
+	constructor()
 	{
-		this.__timers.delete(id);
+		this.__bind(__app.flushCommands());
 	}
 	
-	static get title() {  return Application.__I.__title; }
+	__bind(buffer)
+	{
+		if(this.__i32 && this.__i32.buffer === buffer)
+			return;
+		this.__i32 = new Int32Array(buffer);
+		this.__f32 = new Float32Array(buffer);
+		this.__capacity = this.__i32.length;
+	}
 	
-	static set title(value) 
+	// Returns the index of count free words, flushing when the buffer is full.
+	__reserve(count)
 	{
-		if(Application.__I.__title !== value)
+		let at = this.__i32[0];
+		if(at + count > this.__capacity)
 		{
-			Application.__I.__title = value;
-			__f_app(0, value);
+			this.__bind(__app.flushCommands(true));
+			at = this.__i32[0];
 		}
+		this.__i32[0] = at + count;
+		return at;
 	}
 	
-	static get state() {  return Application.__I.__state; }
+	__write(op, elem, a, b)
+	{
+		const at = this.__reserve(4), i32 = this.__i32;
+		i32[at] = op;
+		i32[at + 1] = elem.__id;
+		i32[at + 2] = a;
+		i32[at + 3] = b;
+	}
 	
-	static set state(value) 
+	__write1(op, elem, a)
 	{
-		if(Application.__I.__state !== value)
-		{
-			Application.__I.__state = value;
-			__f_app(1, value);
-		}
+		const at = this.__reserve(3), i32 = this.__i32;
+		i32[at] = op;
+		i32[at + 1] = elem.__id;
+		i32[at + 2] = a;
 	}
 	
-	static get size() {  return Application.__I.__state; }
+	setPosition(elem, x, y) { this.__write(1, elem, x, y); }
+	setSize(elem, width, height) { this.__write(2, elem, width, height); }
+	setBackgroundColor(elem, color) { this.__write1(3, elem, color); }
+	setOpacity(elem, opacity) { this.__write1(4, elem, Math.round(Math.min(Math.max(opacity, 0), 1) * 255)); }
 	
-	static set size(value) 
+	setRotation(elem, degree)
 	{
-		if(Array.isArray(value))
-			__f_app(2, value[0], value[1]);
-		else
-			__f_app(2, value.width, value.height);
+		const at = this.__reserve(3);
+		this.__i32[at] = 5;
+		this.__i32[at + 1] = elem.__id;
+		this.__f32[at + 2] = degree;
 	}
 	
-	static get() { return Application.__I; }
-	static quit() { __f_app(3); }
-	static close() { __f_app(4); }
+	setVisible(elem, visible) { this.__write1(6, elem, visible ? 1 : 0); }
+	add(parent, child) { this.__write1(7, parent, child.__id); }
+	remove(parent, child) { this.__write1(8, parent, child.__id); }
+	
+	flush() { this.__bind(__app.flushCommands()); }
 }
 
-export function Color(r, g, b, a)
-{
-	const alpha = (a === undefined) ? 255 : a & 0xFF;
-	return ((alpha & 0xFF) << 24) | ((r & 0xFF) << 16) | ((g & 0xFF) << 8) | ((b & 0xFF));
-};
-
 export class Element
 {
 	constructor(props, type, _ptr)
 	{
-		this.__ = (_ptr) ? _ptr : __f_new(1, type, props);
+		this.__ = (_ptr) ? _ptr : new __Element(props);
+		this.__id = this.__.id;
 		this.__onUpdate = null;
 		if(props && props.parent)
 			props.parent.add(this);
@@ -209,15 +283,72 @@ export class Element
 	
 	release()
 	{
-		__f_elem(2, this.__);
+		this.__.release();
 		delete this.__;
+		// Commands recorded from now on are rejected.
+		this.__id = 0;
 	}
 	
 	add(elem)
 	{
-		__f_elem(1, this.__, elem.__);
+		this.__.add(elem.__);
+	}
+	
+	remove(elem)
+	{
+		this.__.remove(elem.__);
 	}
 	
+	layout(props)
+	{
+		this.__.layout(props);
+	}
+	
+	get position() { return this.__.position; }
+	set position(value) { this.__.position = value; }
+	
+	get size() { return this.__.size; }
+	set size(value) { this.__.size = value; }
+	
+	get rotation() { return this.__.rotation; }
+	set rotation(value) { this.__.rotation = value; }
+	
+	get opacity() { return this.__.opacity; }
+	set opacity(value) { this.__.opacity = value; }
+	
+	get visible() { return this.__.visible; }
+	set visible(value) { this.__.visible = value; }
+	
+	get backgroundColor() { return this.__.backgroundColor; }
+	set backgroundColor(value) { this.__.backgroundColor = value; }
+	
+	get overflow() { return this.__.overflow; }
+	set overflow(value) { this.__.overflow = value; }
+	
+	setPosition(x, y)
+	{
+		this.__.setPosition(x, y);
+	}
+	
+	setSize(width, height)
+	{
+		this.__.size = [width, height];
+	}
+	
+	setRotation(degree)
+	{
+		this.__.setRotation(degree);
+	}
+	
+	setOpacity(opacity)
+	{
+		this.__.setOpacity(opacity);
+	}
+	
+	setBackgroundColor(color)
+	{
+		this.__.backgroundColor = color;
+	}
 	
 	on(name, callback)
 	{
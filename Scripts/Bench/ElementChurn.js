@@ -0,0 +1,31 @@
+import { Application, Element, Color } from '../Application.js'
+
+// Creates and releases a batch of elements every frame, exercising
+// allocation, tree updates and layout invalidation.
+export default class ElementChurn extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Element churn' });
+		
+		this.on('load', () =>
+		{
+			this.panel = new Element({ parent: this.stage, size: [1600, 900], position: [160, 90], flex: { direction: 'row', wrap: true, gap: 4, padding: 8 } });
+			this.live = [];
+			this.frame = 0;
+		});
+		
+		this.on('update', () =>
+		{
+			const batch = 100, limit = 2000;
+			for (let i = 0; i < batch; ++i)
+			{
+				const n = this.frame * batch + i;
+				this.live.push(new Element({ parent: this.panel, size: [24 + (n % 5) * 8, 24], backgroundColor: Color((n * 17) & 0xFF, (n * 5) & 0xFF, 200) }));
+			}
+			while (this.live.length > limit)
+				this.live.shift().release();
+			++this.frame;
+		});
+	}
+}
@@ -0,0 +1,36 @@
+import { Application, Element, Color } from '../Application.js'
+
+// Per-call cost of the hot element setters. Run it twice, normally and with
+// --no-fast-api, to compare the fast API path against regular callbacks:
+//   Flint --main=Scripts/Bench/FastApi.js --debug
+//   Flint --main=Scripts/Bench/FastApi.js --debug --no-fast-api
+export default class FastApi extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Fast API' });
+		
+		this.on('load', () =>
+		{
+			const element = new Element({ parent: this.stage, size: [32, 32], position: [0, 0], backgroundColor: Color(200, 40, 40) });
+			const native = element.__;
+			const calls = 2000000;
+			
+			const measure = (name, body) =>
+			{
+				// Warm up so the loop is optimized before it is timed.
+				body(calls / 10);
+				const start = Date.now();
+				body(calls);
+				const elapsed = Date.now() - start;
+				print(name + ': ' + (elapsed * 1e6 / calls).toFixed(1) + ' ns/call');
+			};
+			
+			measure('setPosition', (n) => { for (let i = 0; i < n; ++i) native.setPosition(i & 511, i & 255); });
+			measure('setOpacity', (n) => { for (let i = 0; i < n; ++i) native.setOpacity((i & 255) / 255); });
+			measure('setRotation', (n) => { for (let i = 0; i < n; ++i) native.setRotation(i % 360); });
+			measure('size accessor (reference)', (n) => { for (let i = 0; i < n; ++i) native.size = [32 + (i & 15), 32]; });
+			Application.quit();
+		});
+	}
+}
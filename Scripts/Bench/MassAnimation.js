@@ -0,0 +1,29 @@
+import { Application, Element, Color } from '../Application.js'
+
+// Thousands of small elements moving and rotating independently, each with
+// its own update callback.
+export default class MassAnimation extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Mass animation' });
+		
+		this.on('load', () =>
+		{
+			const count = 3000;
+			for (let i = 0; i < count; ++i)
+			{
+				const cx = 40 + (i * 97) % 1840, cy = 40 + (i * 53) % 1000;
+				const radius = 10 + (i % 30), speed = 0.5 + (i % 7) * 0.25;
+				const sprite = new Element({ parent: this.stage, size: [16, 16], position: [cx, cy], backgroundColor: Color((i * 13) & 0xFF, (i * 29) & 0xFF, (i * 7) & 0xFF) });
+				let time = i * 0.01;
+				sprite.on('update', (delta) =>
+				{
+					time += delta * speed;
+					sprite.setPosition(Math.round(cx + radius * Math.cos(time)), Math.round(cy + radius * Math.sin(time)));
+					sprite.setRotation((time * 90) % 360);
+				});
+			}
+		});
+	}
+}
@@ -0,0 +1,32 @@
+import { Application, Element, Color } from '../Application.js'
+
+// A long list scrolled by a few pixels every frame, the whole viewport is
+// damaged each frame while most rows are clipped.
+export default class ScrollingList extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Scrolling list' });
+		
+		this.on('load', () =>
+		{
+			const count = 1000, height = 48;
+			this.extent = count * height;
+			this.offset = 0;
+			this.list = new Element({ parent: this.stage, size: [800, this.extent], position: [0, 0] });
+			for (let i = 0; i < count; ++i)
+			{
+				const row = new Element({ parent: this.list, size: [800, height - 1], position: [0, i * height], backgroundColor: (i & 1) ? Color(250, 250, 250) : Color(236, 240, 244) });
+				new Element({ parent: row, size: [32, 32], position: [8, 8], backgroundColor: Color((i * 37) & 0xFF, (i * 11) & 0xFF, 160) });
+				new Element({ parent: row, size: [400, 12], position: [56, 10], backgroundColor: Color(90, 90, 90) });
+				new Element({ parent: row, size: [240, 8], position: [56, 30], backgroundColor: Color(160, 160, 160) });
+			}
+		});
+		
+		this.on('update', (delta) =>
+		{
+			this.offset = (this.offset + 240 * delta) % (this.extent - 1200);
+			this.list.setPosition(0, -Math.round(this.offset));
+		});
+	}
+}
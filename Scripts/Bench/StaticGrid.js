@@ -0,0 +1,25 @@
+import { Application, Element, Color } from '../Application.js'
+
+// A full screen grid that never changes after the first frame. Measures the
+// cost of a frame with no damage.
+export default class StaticGrid extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Static grid' });
+		
+		this.on('load', () =>
+		{
+			const columns = 48, rows = 27, width = 40, height = 40;
+			for (let y = 0; y < rows; ++y)
+			{
+				const row = new Element({ parent: this.stage, size: [columns * width, height], position: [0, y * height] });
+				for (let x = 0; x < columns; ++x)
+				{
+					const shade = ((x + y) & 1) ? 220 : 240;
+					new Element({ parent: row, size: [width - 2, height - 2], position: [x * width + 1, 1], backgroundColor: Color(shade, shade, (x * 5) & 0xFF) });
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,33 @@
+import { Application } from '../Application.js'
+
+// A worker calling close() while its module is evaluated must shut down on
+// its own. Prints PASS or FAIL and quits, run it headless with
+//
+//   Flint.exe --bench=Scripts/Tests/WorkerClose.js --frames=100000
+export default class WorkerClose extends Application
+{
+	constructor() 
+	{
+		super({ title: 'Worker close' });
+		
+		this.on('load', () =>
+		{
+			this.worker = new Worker('./WorkerCloseModule.js');
+			this.deadline = Date.now() + 2000;
+		});
+		
+		this.on('update', () =>
+		{
+			if (!this.worker)
+				return;
+			if (this.worker.closed)
+				console.log('PASS worker closed itself during module evaluation');
+			else if (Date.now() > this.deadline)
+				console.error('FAIL worker still running 2 s after close()');
+			else
+				return;
+			this.worker = null;
+			Application.quit();
+		});
+	}
+}
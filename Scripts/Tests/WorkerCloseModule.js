@@ -0,0 +1,2 @@
+// Closes the worker from its top level code, before any message arrives.
+close();
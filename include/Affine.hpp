@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Types.hpp"
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FLINT_AFFINE_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLINT_AFFINE_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define FLINT_AFFINE_NEON
+#endif
+
+namespace flint
+{
+
+	// 2D affine transform, the top two rows of a 3x3 matrix:
+	// | a  c  tx |
+	// | b  d  ty |
+	struct Affine
+	{
+		Affine(float _a = 1, float _b = 0, float _c = 0, float _d = 1, float _tx = 0, float _ty = 0) : a(_a), b(_b), c(_c), d(_d), tx(_tx), ty(_ty) {}
+
+		static Affine Rotation(float radians)
+		{
+			const float s = std::sin(radians);
+			const float cs = std::cos(radians);
+			return Affine(cs, s, -s, cs, 0, 0);
+		}
+
+		bool isTranslation() const { return a == 1 && b == 0 && c == 0 && d == 1; }
+
+		// Returns this * m, i.e. m is applied first.
+		Affine operator * (const Affine& m) const
+		{
+			return Affine(a * m.a + c * m.b, b * m.a + d * m.b,
+						  a * m.c + c * m.d, b * m.c + d * m.d,
+						  a * m.tx + c * m.ty + tx, b * m.tx + d * m.ty + ty);
+		}
+
+		void setTranslation(float x, float y)
+		{
+			tx = x;
+			ty = y;
+		}
+
+		void preTranslate(float x, float y)
+		{
+			tx += a * x + c * y;
+			ty += b * x + d * y;
+		}
+
+		void postTranslate(float x, float y)
+		{
+			tx += x;
+			ty += y;
+		}
+
+		float a, b, c, d, tx, ty;
+	};
+
+	namespace affine
+	{
+		inline void mapBoundScalar(const Affine& m, const Bound& in, Bound& out)
+		{
+			if (m.isTranslation())
+			{
+				out.left = (Position::Type)std::floor(in.left + m.tx);
+				out.top = (Position::Type)std::floor(in.top + m.ty);
+				out.right = (Position::Type)std::ceil(in.right + m.tx);
+				out.bottom = (Position::Type)std::ceil(in.bottom + m.ty);
+				return;
+			}
+			const float ax0 = m.a * in.left, ax1 = m.a * in.right;
+			const float bx0 = m.b * in.left, bx1 = m.b * in.right;
+			const float cy0 = m.c * in.top, cy1 = m.c * in.bottom;
+			const float dy0 = m.d * in.top, dy1 = m.d * in.bottom;
+			out.left = (Position::Type)std::floor(std::min(ax0, ax1) + std::min(cy0, cy1) + m.tx);
+			out.right = (Position::Type)std::ceil(std::max(ax0, ax1) + std::max(cy0, cy1) + m.tx);
+			out.top = (Position::Type)std::floor(std::min(bx0, bx1) + std::min(dy0, dy1) + m.ty);
+			out.bottom = (Position::Type)std::ceil(std::max(bx0, bx1) + std::max(dy0, dy1) + m.ty);
+		}
+
+		// Maps count bounds through their matching transforms and writes the
+		// axis aligned result. Sibling arrays are processed in one pass so the
+		// vector units work on several corners per instruction.
+		inline void mapBounds(const Affine* pTransforms, const Bound* pIn, Bound* pOut, size_t count)
+		{
+			size_t i = 0;
+#if defined(FLINT_AFFINE_AVX)
+			for (; i + 2 <= count; i += 2)
+			{
+				const Affine& m0 = pTransforms[i];
+				const Affine& m1 = pTransforms[i + 1];
+				const Bound& b0 = pIn[i];
+				const Bound& b1 = pIn[i + 1];
+				const __m256 xs = _mm256_setr_ps((float)b0.left, (float)b0.right, (float)b0.left, (float)b0.right, (float)b1.left, (float)b1.right, (float)b1.left, (float)b1.right);
+				const __m256 ys = _mm256_setr_ps((float)b0.top, (float)b0.top, (float)b0.bottom, (float)b0.bottom, (float)b1.top, (float)b1.top, (float)b1.bottom, (float)b1.bottom);
+				const __m256 ma = _mm256_setr_ps(m0.a, m0.a, m0.a, m0.a, m1.a, m1.a, m1.a, m1.a);
+				const __m256 mb = _mm256_setr_ps(m0.b, m0.b, m0.b, m0.b, m1.b, m1.b, m1.b, m1.b);
+				const __m256 mc = _mm256_setr_ps(m0.c, m0.c, m0.c, m0.c, m1.c, m1.c, m1.c, m1.c);
+				const __m256 md = _mm256_setr_ps(m0.d, m0.d, m0.d, m0.d, m1.d, m1.d, m1.d, m1.d);
+				const __m256 X = _mm256_add_ps(_mm256_mul_ps(ma, xs), _mm256_mul_ps(mc, ys));
+				const __m256 Y = _mm256_add_ps(_mm256_mul_ps(mb, xs), _mm256_mul_ps(md, ys));
+				__m256 minX = _mm256_min_ps(X, _mm256_shuffle_ps(X, X, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m256 maxX = _mm256_max_ps(X, _mm256_shuffle_ps(X, X, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m256 minY = _mm256_min_ps(Y, _mm256_shuffle_ps(Y, Y, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m256 maxY = _mm256_max_ps(Y, _mm256_shuffle_ps(Y, Y, _MM_SHUFFLE(2, 3, 0, 1)));
+				minX = _mm256_min_ps(minX, _mm256_shuffle_ps(minX, minX, _MM_SHUFFLE(1, 0, 3, 2)));
+				maxX = _mm256_max_ps(maxX, _mm256_shuffle_ps(maxX, maxX, _MM_SHUFFLE(1, 0, 3, 2)));
+				minY = _mm256_min_ps(minY, _mm256_shuffle_ps(minY, minY, _MM_SHUFFLE(1, 0, 3, 2)));
+				maxY = _mm256_max_ps(maxY, _mm256_shuffle_ps(maxY, maxY, _MM_SHUFFLE(1, 0, 3, 2)));
+				alignas(32) float lx[8], hx[8], ly[8], hy[8];
+				_mm256_store_ps(lx, minX);
+				_mm256_store_ps(hx, maxX);
+				_mm256_store_ps(ly, minY);
+				_mm256_store_ps(hy, maxY);
+				pOut[i] = Bound((Position::Type)std::floor(lx[0] + m0.tx), (Position::Type)std::floor(ly[0] + m0.ty), (Position::Type)std::ceil(hx[0] + m0.tx), (Position::Type)std::ceil(hy[0] + m0.ty));
+				pOut[i + 1] = Bound((Position::Type)std::floor(lx[4] + m1.tx), (Position::Type)std::floor(ly[4] + m1.ty), (Position::Type)std::ceil(hx[4] + m1.tx), (Position::Type)std::ceil(hy[4] + m1.ty));
+			}
+#endif
+#if defined(FLINT_AFFINE_SSE)
+			for (; i < count; ++i)
+			{
+				const Affine& m = pTransforms[i];
+				const Bound& b = pIn[i];
+				const __m128 xs = _mm_setr_ps((float)b.left, (float)b.right, (float)b.left, (float)b.right);
+				const __m128 ys = _mm_setr_ps((float)b.top, (float)b.top, (float)b.bottom, (float)b.bottom);
+				const __m128 X = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.a), xs), _mm_mul_ps(_mm_set1_ps(m.c), ys));
+				const __m128 Y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.b), xs), _mm_mul_ps(_mm_set1_ps(m.d), ys));
+				__m128 minX = _mm_min_ps(X, _mm_shuffle_ps(X, X, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m128 maxX = _mm_max_ps(X, _mm_shuffle_ps(X, X, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m128 minY = _mm_min_ps(Y, _mm_shuffle_ps(Y, Y, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m128 maxY = _mm_max_ps(Y, _mm_shuffle_ps(Y, Y, _MM_SHUFFLE(2, 3, 0, 1)));
+				minX = _mm_min_ss(minX, _mm_movehl_ps(minX, minX));
+				maxX = _mm_max_ss(maxX, _mm_movehl_ps(maxX, maxX));
+				minY = _mm_min_ss(minY, _mm_movehl_ps(minY, minY));
+				maxY = _mm_max_ss(maxY, _mm_movehl_ps(maxY, maxY));
+				pOut[i] = Bound((Position::Type)std::floor(_mm_cvtss_f32(minX) + m.tx), (Position::Type)std::floor(_mm_cvtss_f32(minY) + m.ty),
+								(Position::Type)std::ceil(_mm_cvtss_f32(maxX) + m.tx), (Position::Type)std::ceil(_mm_cvtss_f32(maxY) + m.ty));
+			}
+#elif defined(FLINT_AFFINE_NEON)
+			for (; i < count; ++i)
+			{
+				const Affine& m = pTransforms[i];
+				const Bound& b = pIn[i];
+				const float xv[4] = { (float)b.left, (float)b.right, (float)b.left, (float)b.right };
+				const float yv[4] = { (float)b.top, (float)b.top, (float)b.bottom, (float)b.bottom };
+				const float32x4_t xs = vld1q_f32(xv);
+				const float32x4_t ys = vld1q_f32(yv);
+				const float32x4_t X = vmlaq_n_f32(vmulq_n_f32(xs, m.a), ys, m.c);
+				const float32x4_t Y = vmlaq_n_f32(vmulq_n_f32(xs, m.b), ys, m.d);
+				pOut[i] = Bound((Position::Type)std::floor(vminvq_f32(X) + m.tx), (Position::Type)std::floor(vminvq_f32(Y) + m.ty),
+								(Position::Type)std::ceil(vmaxvq_f32(X) + m.tx), (Position::Type)std::ceil(vmaxvq_f32(Y) + m.ty));
+			}
+#else
+			for (; i < count; ++i)
+				mapBoundScalar(pTransforms[i], pIn[i], pOut[i]);
+#endif
+		}
+
+		inline Bound mapBound(const Affine& m, const Bound& in)
+		{
+			Bound out;
+			mapBoundScalar(m, in, out);
+			return out;
+		}
+	}
+
+}
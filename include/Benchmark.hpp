@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Types.hpp"
+#include "FrameStats.hpp"
+#include <string>
+#include <vector>
+
+namespace flint
+{
+
+	struct BenchmarkParameters
+	{
+		BenchmarkParameters() : frames(1000),
+								threshold(0.1f)
+		{
+		}
+
+		uint32_t frames;
+		float threshold;		// allowed relative regression against the baseline
+		std::string output;		// results file, printed to the console when empty
+		std::string baseline;
+	};
+
+	// Collects the statistics of every frame of a headless run and reports
+	// percentiles of the frame time and of each phase.
+	class Benchmark
+	{
+	public:
+
+		// Frames at the start of a run excluded from the results while the
+		// script is compiled and optimized.
+		static const uint32_t WARMUP_FRAMES = 30;
+
+		explicit Benchmark(const BenchmarkParameters& params);
+
+		const BenchmarkParameters& getParameters() const { return m_params; }
+		bool isDone() const { return m_nFrame >= m_params.frames + WARMUP_FRAMES; }
+		float getTimestep() const { return 1.0f / 60.0f; }
+
+		void record(const FrameStats& stats, float frameTime);
+
+		// Writes the results and compares them with the baseline, returns
+		// false when a phase regressed by more than the threshold.
+		bool finish(const std::string& scene, const Size& size);
+
+	private:
+
+		std::string toJSON(const std::string& scene, const Size& size) const;
+		bool compare(const std::string& results) const;
+
+		BenchmarkParameters		m_params;
+		uint32_t				m_nFrame;
+		std::vector<FrameStats>	m_vecFrames;
+		std::vector<float>		m_vecFrameTimes;
+	};
+
+}
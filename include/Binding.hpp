@@ -0,0 +1,526 @@
+#pragma once
+
+#include "include/v8.h"
+#include "include/v8-fast-api-calls.h"
+#include "Types.hpp"
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace flint
+{
+	namespace javascript
+	{
+		// Compile time generated V8 bindings. Methods and accessors are
+		// described by function pointers and expanded into callbacks which
+		// unwrap the receiver, check and convert every argument and convert
+		// the result, so exposing a property is one line and calling it
+		// costs no more than a hand written callback.
+		namespace binding
+		{
+			// Property names read or called from native code. They are
+			// internalized once per isolate, so lookups neither allocate nor
+			// hash a new string.
+			enum class Name
+			{
+				X = 0,
+				Y,
+				WIDTH,
+				HEIGHT,
+				SIZE,
+				POSITION,
+				BACKGROUND_COLOR,
+				FLEX,
+				DIRECTION,
+				WRAP,
+				GAP,
+				JUSTIFY,
+				ALIGN,
+				PADDING,
+				GROW,
+				SHRINK,
+				BASIS,
+				ALIGN_SELF,
+				TITLE,
+				STATE,
+				RES,
+				UPDATE,
+				LOAD,
+				FIRE_EVENT,
+				ON_BEFORE_UNLOAD,
+				ON_UNLOAD,
+				COUNT
+			};
+
+			class Names
+			{
+			public:
+
+				// Isolate data slot holding the table.
+				static const uint32_t SLOT = 1;
+
+				explicit Names(v8::Isolate* pIsolate)
+				{
+					static const char* const Strings[(int)Name::COUNT] =
+					{
+						"x", "y", "width", "height", "size", "position", "backgroundColor", "flex", "direction", "wrap", "gap",
+						"justify", "align", "padding", "grow", "shrink", "basis", "alignSelf", "title", "state", "res", "update",
+						"load", "fireEvent", "onbeforeunload", "onunload"
+					};
+					v8::HandleScope scope(pIsolate);
+					for (int i = 0; i < (int)Name::COUNT; ++i)
+						m_strings[i].Set(pIsolate, v8::String::NewFromUtf8(pIsolate, Strings[i], v8::NewStringType::kInternalized).ToLocalChecked());
+					pIsolate->SetData(SLOT, this);
+				}
+
+				Names(const Names&) = delete;
+				Names& operator = (const Names&) = delete;
+
+				v8::Local<v8::String> get(v8::Isolate* pIsolate, Name name) const { return m_strings[(int)name].Get(pIsolate); }
+
+			private:
+
+				v8::Eternal<v8::String> m_strings[(int)Name::COUNT];
+			};
+
+			inline v8::Local<v8::String> getString(v8::Isolate* pIsolate, Name name)
+			{
+				return reinterpret_cast<const Names*>(pIsolate->GetData(Names::SLOT))->get(pIsolate, name);
+			}
+
+			// Conversion between JavaScript values and C++ types. from()
+			// returns false when the value has the wrong type, Storage holds
+			// the converted value for the duration of the call.
+			template <typename T, typename Enable = void>
+			struct Convert;
+
+			template <>
+			struct Convert<bool>
+			{
+				using Storage = bool;
+				static const char* name() { return "boolean"; }
+				static bool from(v8::Isolate* pIsolate, v8::Local<v8::Context>, v8::Local<v8::Value> value, Storage& out) { out = value->BooleanValue(pIsolate); return true; }
+				static bool get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, bool value) { return v8::Boolean::New(pIsolate, value); }
+			};
+
+			template <typename T>
+			struct Convert<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type>
+			{
+				using Storage = T;
+				static const char* name() { return "number"; }
+				static bool from(v8::Isolate*, v8::Local<v8::Context>, v8::Local<v8::Value> value, Storage& out)
+				{
+					if (!value->IsNumber())
+						return false;
+					const double number = value.As<v8::Number>()->Value();
+					if (std::is_integral<T>::value && !(number >= (double)std::numeric_limits<T>::lowest() && number <= (double)std::numeric_limits<T>::max()))
+						return false;
+					out = (T)number;
+					return true;
+				}
+				static T get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, T value) { return v8::Number::New(pIsolate, (double)value); }
+			};
+
+			// Enumerations travel as numbers, specialize Range to reject
+			// values outside the enumeration.
+			template <typename T>
+			struct Range
+			{
+				static bool contains(int32_t) { return true; }
+			};
+
+			template <typename T>
+			struct Convert<T, typename std::enable_if<std::is_enum<T>::value>::type>
+			{
+				using Storage = T;
+				static const char* name() { return "enumeration value"; }
+				static bool from(v8::Isolate*, v8::Local<v8::Context>, v8::Local<v8::Value> value, Storage& out)
+				{
+					if (!value->IsInt32() || !Range<T>::contains(value.As<v8::Int32>()->Value()))
+						return false;
+					out = (T)value.As<v8::Int32>()->Value();
+					return true;
+				}
+				static T get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, T value) { return v8::Integer::New(pIsolate, (int32_t)value); }
+			};
+
+			template <>
+			struct Convert<Position>
+			{
+				using Storage = Position;
+				static const char* name() { return "[x, y] or {x, y}"; }
+				static bool from(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value, Storage& out)
+				{
+					double x, y;
+					if (!getPair(pIsolate, context, value, Name::X, Name::Y, x, y))
+						return false;
+					out = Position((Position::Type)x, (Position::Type)y);
+					return true;
+				}
+				static Position get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const Position& value)
+				{
+					v8::Local<v8::Value> values[] = { v8::Integer::New(pIsolate, value.x), v8::Integer::New(pIsolate, value.y) };
+					return v8::Array::New(pIsolate, values, 2);
+				}
+
+				// Reads an array of two numbers or an object with two named numbers.
+				static bool getPair(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value, Name first, Name second, double& a, double& b)
+				{
+					v8::Local<v8::Value> va, vb;
+					if (value->IsArray())
+					{
+						v8::Local<v8::Array> array = value.As<v8::Array>();
+						if (array->Length() < 2 || !array->Get(context, 0).ToLocal(&va) || !array->Get(context, 1).ToLocal(&vb))
+							return false;
+					}
+					else if (value->IsObject())
+					{
+						v8::Local<v8::Object> object = value.As<v8::Object>();
+						if (!object->Get(context, getString(pIsolate, first)).ToLocal(&va) || !object->Get(context, getString(pIsolate, second)).ToLocal(&vb))
+							return false;
+					}
+					else
+						return false;
+					if (!va->IsNumber() || !vb->IsNumber())
+						return false;
+					a = va.As<v8::Number>()->Value();
+					b = vb.As<v8::Number>()->Value();
+					return true;
+				}
+			};
+
+			template <>
+			struct Convert<Size>
+			{
+				using Storage = Size;
+				static const char* name() { return "[width, height] or {width, height}"; }
+				static bool from(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value, Storage& out)
+				{
+					double width, height;
+					if (!Convert<Position>::getPair(pIsolate, context, value, Name::WIDTH, Name::HEIGHT, width, height) || width < 0 || height < 0 || width > 0xFFFF || height > 0xFFFF)
+						return false;
+					out = Size((Size::Type)width, (Size::Type)height);
+					return true;
+				}
+				static Size get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const Size& value)
+				{
+					v8::Local<v8::Value> values[] = { v8::Integer::NewFromUnsigned(pIsolate, value.width), v8::Integer::NewFromUnsigned(pIsolate, value.height) };
+					return v8::Array::New(pIsolate, values, 2);
+				}
+			};
+
+			// Colors are 0xAARRGGBB numbers, as produced by Color() in Application.js.
+			template <>
+			struct Convert<Color>
+			{
+				using Storage = Color;
+				static const char* name() { return "color"; }
+				static bool from(v8::Isolate*, v8::Local<v8::Context> context, v8::Local<v8::Value> value, Storage& out)
+				{
+					if (!value->IsNumber())
+						return false;
+					out = Color(value->Uint32Value(context).FromJust());
+					return true;
+				}
+				static Color get(Storage& s) { return s; }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const Color& value)
+				{
+					return v8::Integer::NewFromUnsigned(pIsolate, ((uint32_t)value.alpha << 24) | ((uint32_t)value.red << 16) | ((uint32_t)value.green << 8) | value.blue);
+				}
+			};
+
+			template <>
+			struct Convert<const wchar_t*>
+			{
+				using Storage = std::wstring;
+				static const char* name() { return "string"; }
+				static bool from(v8::Isolate* pIsolate, v8::Local<v8::Context>, v8::Local<v8::Value> value, Storage& out)
+				{
+					if (!value->IsString())
+						return false;
+					v8::String::Value str(pIsolate, value);
+					out.assign((const wchar_t*)*str, str.length());
+					return true;
+				}
+				static const wchar_t* get(Storage& s) { return s.c_str(); }
+				static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const wchar_t* value)
+				{
+					return v8::String::NewFromTwoByte(pIsolate, (const uint16_t*)value).ToLocalChecked();
+				}
+			};
+
+			// Bumped when the internal fields of wrapped objects change, the
+			// templates in a startup snapshot depend on them.
+			static const uint32_t LAYOUT_VERSION = 1;
+
+			// Identifies the class of a wrapped object. Only the address is
+			// used, it is writable so the linker can't fold the tags.
+			template <typename T>
+			struct TypeTag
+			{
+				static inline int tag = 0;
+			};
+
+			// Native objects are wrapped with their pointer in internal field 0,
+			// a null pointer marks a released object. The last field holds the
+			// class tag, so objects of other classes are never cast to T.
+			template <typename T>
+			void wrap(v8::Local<v8::Object> object, T* pObject)
+			{
+				object->SetAlignedPointerInInternalField(0, pObject);
+				object->SetAlignedPointerInInternalField(object->InternalFieldCount() - 1, &TypeTag<T>::tag);
+			}
+
+			template <typename T>
+			T* unwrap(v8::Local<v8::Value> value)
+			{
+				if (!value->IsObject())
+					return nullptr;
+				v8::Local<v8::Object> object = value.As<v8::Object>();
+				const int count = object->InternalFieldCount();
+				if (count < 2 || object->GetAlignedPointerFromInternalField(count - 1) != &TypeTag<T>::tag)
+					return nullptr;
+				return reinterpret_cast<T*>(object->GetAlignedPointerFromInternalField(0));
+			}
+
+			// Fast calls only see receivers which passed the signature check.
+			template <typename T>
+			T* unwrap(v8::ApiObject receiver)
+			{
+				return reinterpret_cast<T*>(reinterpret_cast<v8::Object*>(&receiver)->GetAlignedPointerFromInternalField(0));
+			}
+
+			template <typename T>
+			struct Convert<T*, typename std::enable_if<std::is_class<T>::value>::type>
+			{
+				using Storage = T*;
+				static const char* name() { return "native object"; }
+				static bool from(v8::Isolate*, v8::Local<v8::Context>, v8::Local<v8::Value> value, Storage& out)
+				{
+					out = unwrap<T>(value);
+					return out != nullptr;
+				}
+				static T* get(Storage& s) { return s; }
+			};
+
+			// Signature of a bound function. Member functions are called on
+			// the receiver, free functions receive it as first argument which
+			// allows small adapters for members that don't map one to one.
+			template <typename F>
+			struct Function;
+
+			template <typename C, typename R, typename... A>
+			struct Function<R (C::*)(A...)>
+			{
+				using Class = C;
+				using Return = R;
+				using Arguments = std::tuple<typename std::decay<A>::type...>;
+				template <R (C::*F)(A...), typename... V>
+				static R call(C& object, V&&... args) { return (object.*F)(std::forward<V>(args)...); }
+			};
+
+			template <typename C, typename R, typename... A>
+			struct Function<R (C::*)(A...) const>
+			{
+				using Class = C;
+				using Return = R;
+				using Arguments = std::tuple<typename std::decay<A>::type...>;
+				template <R (C::*F)(A...) const, typename... V>
+				static R call(C& object, V&&... args) { return (object.*F)(std::forward<V>(args)...); }
+			};
+
+			template <typename C, typename R, typename... A>
+			struct Function<R (*)(C&, A...)>
+			{
+				using Class = C;
+				using Return = R;
+				using Arguments = std::tuple<typename std::decay<A>::type...>;
+				template <R (*F)(C&, A...), typename... V>
+				static R call(C& object, V&&... args) { return F(object, std::forward<V>(args)...); }
+			};
+
+			inline void throwError(v8::Isolate* pIsolate, const std::string& message)
+			{
+				pIsolate->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(pIsolate, message.c_str(), v8::NewStringType::kNormal, (int)message.size()).ToLocalChecked()));
+			}
+
+			// The bound name is passed as callback data and only read to
+			// describe errors.
+			inline std::string getName(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				v8::String::Utf8Value name(args.GetIsolate(), args.Data());
+				return *name ? *name : "";
+			}
+
+			template <auto F, size_t... I>
+			void call(const v8::FunctionCallbackInfo<v8::Value>& args, typename Function<decltype(F)>::Class& object, std::index_sequence<I...>)
+			{
+				using Traits = Function<decltype(F)>;
+				using Arguments = typename Traits::Arguments;
+				using Return = typename Traits::Return;
+				v8::Isolate* pIsolate = args.GetIsolate();
+				v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+				std::tuple<typename Convert<typename std::tuple_element<I, Arguments>::type>::Storage...> storage;
+				int failed = -1;
+				const bool bValid = ((Convert<typename std::tuple_element<I, Arguments>::type>::from(pIsolate, context, args[(int)I], std::get<I>(storage)) || (failed = (int)I, false)) && ... && true);
+				if (!bValid)
+				{
+					static const char* const Types[] = { Convert<typename std::tuple_element<I, Arguments>::type>::name()..., "" };
+					throwError(pIsolate, getName(args) + ": argument " + std::to_string(failed + 1) + " must be a " + Types[failed]);
+					return;
+				}
+				(void)context;
+				if constexpr (std::is_void<Return>::value)
+					Traits::template call<F>(object, Convert<typename std::tuple_element<I, Arguments>::type>::get(std::get<I>(storage))...);
+				else
+					args.GetReturnValue().Set(Convert<typename std::decay<Return>::type>::to(pIsolate, Traits::template call<F>(object, Convert<typename std::tuple_element<I, Arguments>::type>::get(std::get<I>(storage))...)));
+			}
+
+			template <auto F>
+			void invoke(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				using Traits = Function<decltype(F)>;
+				typename Traits::Class* pObject = unwrap<typename Traits::Class>(args.This());
+				if (pObject == nullptr)
+				{
+					throwError(args.GetIsolate(), getName(args) + ": object has been released");
+					return;
+				}
+				call<F>(args, *pObject, std::make_index_sequence<std::tuple_size<typename Traits::Arguments>::value>());
+			}
+
+			// Builds a FunctionTemplate whose instances wrap a T. Methods and
+			// accessors are installed on the prototype and carry a signature,
+			// so V8 rejects foreign receivers before the callback runs.
+			template <typename T>
+			class Class
+			{
+			public:
+
+				// Field 0 holds the native pointer, further fields are free for
+				// the owner of the class. One more is added for the class tag,
+				// instances are set up with wrap().
+				Class(v8::Isolate* pIsolate, const char* name, v8::FunctionCallback constructor = nullptr, int fields = 1) : m_pIsolate(pIsolate)
+				{
+					m_template = v8::FunctionTemplate::New(pIsolate, constructor);
+					m_template->SetClassName(v8::String::NewFromUtf8(pIsolate, name).ToLocalChecked());
+					m_template->InstanceTemplate()->SetInternalFieldCount(fields + 1);
+					m_signature = v8::Signature::New(pIsolate, m_template);
+				}
+
+				template <auto F>
+				Class& method(const char* name, const v8::CFunction* pFast = nullptr)
+				{
+					return method(name, &invoke<F>, pFast);
+				}
+
+				// Hand written callback for methods that need the arguments
+				// object, e.g. to read option bags.
+				Class& method(const char* name, v8::FunctionCallback callback, const v8::CFunction* pFast = nullptr)
+				{
+					v8::Local<v8::String> key = v8::String::NewFromUtf8(m_pIsolate, name).ToLocalChecked();
+					v8::Local<v8::FunctionTemplate> function = v8::FunctionTemplate::New(m_pIsolate, callback, key, m_signature, 0, v8::ConstructorBehavior::kThrow, v8::SideEffectType::kHasSideEffect, pFast);
+					m_template->PrototypeTemplate()->Set(key, function);
+					return *this;
+				}
+
+				template <auto Getter, auto Setter = nullptr>
+				Class& property(const char* name)
+				{
+					v8::Local<v8::String> key = v8::String::NewFromUtf8(m_pIsolate, name).ToLocalChecked();
+					v8::Local<v8::FunctionTemplate> getter = v8::FunctionTemplate::New(m_pIsolate, &invoke<Getter>, key, m_signature, 0, v8::ConstructorBehavior::kThrow, v8::SideEffectType::kHasNoSideEffect);
+					v8::Local<v8::FunctionTemplate> setter;
+					if constexpr (!std::is_same<decltype(Setter), std::nullptr_t>::value)
+						setter = v8::FunctionTemplate::New(m_pIsolate, &invoke<Setter>, key, m_signature, 1, v8::ConstructorBehavior::kThrow);
+					m_template->PrototypeTemplate()->SetAccessorProperty(key, getter, setter);
+					return *this;
+				}
+
+				// Read only property with a hand written getter.
+				Class& property(const char* name, v8::FunctionCallback getter)
+				{
+					v8::Local<v8::String> key = v8::String::NewFromUtf8(m_pIsolate, name).ToLocalChecked();
+					m_template->PrototypeTemplate()->SetAccessorProperty(key, v8::FunctionTemplate::New(m_pIsolate, getter, key, m_signature, 0, v8::ConstructorBehavior::kThrow, v8::SideEffectType::kHasNoSideEffect));
+					return *this;
+				}
+
+				v8::Local<v8::FunctionTemplate> get() const { return m_template; }
+
+			private:
+
+				v8::Isolate* m_pIsolate;
+				v8::Local<v8::FunctionTemplate> m_template;
+				v8::Local<v8::Signature> m_signature;
+			};
+
+			// Collects the native addresses a class description installs with
+			// the same calls as Class. V8 needs them as external references
+			// to create and to deserialize a startup snapshot.
+			class References
+			{
+			public:
+
+				template <auto F>
+				References& method(const char* name, const v8::CFunction* pFast = nullptr)
+				{
+					return method(name, &invoke<F>, pFast);
+				}
+
+				References& method(const char*, v8::FunctionCallback callback, const v8::CFunction* pFast = nullptr)
+				{
+					add(callback);
+					if (pFast)
+					{
+						m_vecReferences.push_back(reinterpret_cast<intptr_t>(pFast->GetAddress()));
+						m_vecReferences.push_back(reinterpret_cast<intptr_t>(pFast->GetTypeInfo()));
+					}
+					return *this;
+				}
+
+				template <auto Getter, auto Setter = nullptr>
+				References& property(const char*)
+				{
+					add(&invoke<Getter>);
+					if constexpr (!std::is_same<decltype(Setter), std::nullptr_t>::value)
+						add(&invoke<Setter>);
+					return *this;
+				}
+
+				References& property(const char*, v8::FunctionCallback getter)
+				{
+					add(getter);
+					return *this;
+				}
+
+				void add(v8::FunctionCallback callback)
+				{
+					m_vecReferences.push_back(reinterpret_cast<intptr_t>(callback));
+				}
+
+				bool empty() const { return m_vecReferences.empty(); }
+
+				// Null terminated, as V8 expects it.
+				const intptr_t* get()
+				{
+					if (m_vecReferences.empty() || m_vecReferences.back() != 0)
+						m_vecReferences.push_back(0);
+					return m_vecReferences.data();
+				}
+
+			private:
+
+				std::vector<intptr_t> m_vecReferences;
+			};
+		}
+	}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "include/v8.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace flint
+{
+	namespace javascript
+	{
+		// Compiled module code kept on disk next to the sources. Entries are
+		// keyed by a hash of the source text and of the V8 version and flags,
+		// so edited sources or another V8 build simply miss.
+		class CodeCache
+		{
+		public:
+
+			struct Stats
+			{
+				uint32_t hits;
+				uint32_t misses;
+				uint32_t rejected;		// entries V8 refused, counted as misses too
+				uint32_t written;
+				float compileTime;		// milliseconds spent in CompileModule
+			};
+
+			CodeCache();
+
+			static uint64_t hash(const void* data, size_t size);
+
+			// Returns the cached code of the source at path or null, the
+			// caller passes it to a ScriptCompiler::Source which owns it.
+			v8::ScriptCompiler::CachedData* load(const std::wstring& path, uint64_t sourceHash) const;
+
+			// Serializes the code of a compiled and evaluated module.
+			bool store(const std::wstring& path, uint64_t sourceHash, v8::Local<v8::Module> module);
+
+			Stats& getStats() { return m_stats; }
+			void report() const;
+
+		private:
+
+			static std::wstring getCachePath(const std::wstring& path);
+
+			uint64_t	m_nVersion;
+			Stats		m_stats;
+		};
+	}
+}
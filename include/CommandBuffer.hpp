@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace flint
+{
+	class IRenderElement;
+
+	// Element mutations recorded by scripts as 32 bit words and applied in a
+	// single pass before the frame is rendered. Elements are addressed by
+	// ids handed out when they are registered; id 0 is never valid. The low
+	// bits of an id are a slot, the high bits count how often the slot was
+	// reused, so commands recorded for a released element are rejected
+	// instead of reaching the element that took over its slot.
+	//
+	// Layout of the buffer: word 0 holds the number of words written,
+	// header included, followed by commands of an opcode, the target id and
+	// the operands listed below.
+	class CommandBuffer
+	{
+	public:
+
+		enum Op
+		{
+			SET_POSITION = 1,		// x, y
+			SET_SIZE,				// width, height
+			SET_BACKGROUND_COLOR,	// 0xAARRGGBB
+			SET_OPACITY,			// 0..255
+			SET_ROTATION,			// degrees, float bits
+			SET_VISIBLE,			// 0 or 1
+			ADD_CHILD,				// child id
+			REMOVE_CHILD,			// child id
+			OP_COUNT
+		};
+
+		static const uint32_t INDEX_BITS = 22;
+		static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+		static const uint32_t HEADER_SIZE = 1;
+		static const uint32_t INITIAL_CAPACITY = 4096;			// words
+		static const uint32_t MAXIMUM_CAPACITY = 1024 * 1024;
+
+		CommandBuffer();
+		CommandBuffer(const CommandBuffer&) = delete;
+		CommandBuffer& operator = (const CommandBuffer&) = delete;
+
+		// Returns 0 when every slot is taken.
+		uint32_t add(IRenderElement* pElement);
+		void remove(uint32_t id);
+
+		IRenderElement* get(uint32_t id) const
+		{
+			const uint32_t index = id & INDEX_MASK;
+			return (index < m_vecElements.size() && m_vecGenerations[index] == id >> INDEX_BITS) ? m_vecElements[index] : nullptr;
+		}
+
+		// Applies the commands of a buffer of capacity words and resets its
+		// header. Malformed commands are skipped, an unknown opcode or a
+		// truncated command ends the pass since the rest can't be decoded.
+		// Returns the number of rejected commands.
+		uint32_t execute(uint32_t* pWords, uint32_t capacity);
+
+		// Capacity for the next buffer after the script overflowed one of
+		// the given size.
+		static uint32_t grow(uint32_t capacity);
+
+		uint32_t getExecuted() const { return m_nExecuted; }
+		// Number of REMOVE_CHILD commands applied so far.
+		uint32_t getRemoved() const { return m_nRemoved; }
+
+	private:
+
+		std::vector<IRenderElement*>	m_vecElements;
+		std::vector<uint32_t>			m_vecGenerations;
+		std::vector<uint32_t>			m_vecFree;
+		uint32_t						m_nExecuted;
+		uint32_t						m_nRemoved;
+	};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flint
+{
+	// Buffered console output. Messages are copied into a fixed size ring
+	// of slots which any thread reserves with a compare and swap, a writer
+	// thread formats them with their timestamp and writes them to stdout
+	// and the log file. Writing never blocks: when the ring is full the
+	// message is dropped and counted, the writer reports the count.
+	namespace console
+	{
+		enum class Level : uint8_t
+		{
+			LOG = 0,
+			INFO,
+			WARN,
+			ERR
+		};
+
+		// Longer messages are truncated.
+		static const size_t MAX_MESSAGE = 3328;
+
+		// Starts the writer thread, path is an optional log file. Messages
+		// written before are written synchronously.
+		bool start(const char* path = nullptr);
+		// Writes the buffered messages and stops the writer thread.
+		void stop();
+
+		// Messages below level are discarded.
+		void setLevel(Level level);
+		bool isEnabled(Level level);
+		// Parses "log", "info", "warn" or "error".
+		bool parseLevel(const char* name, Level& level);
+
+		// False when the message was filtered or dropped.
+		bool write(Level level, const char* text, size_t length);
+		uint64_t getDropped();
+	}
+
+}
@@ -2,11 +2,13 @@
 
 #include "Types.hpp"
 #include "EngineEventListener.hpp"
+#include "FrameStats.hpp"
 #include <string>
 
 namespace flint
 {
 	class Renderer;
+	class Benchmark;
 	namespace platform { class Window; }
 	namespace javascript {	class Interface; }
 
@@ -22,7 +24,11 @@ namespace flint
 		EngineParameters() : size(Size(600, 400)),
 				 			 title(L"Flint"),
 							 commandLine(0),
-							 state(EngineState::NORMAL)
+							 state(EngineState::NORMAL),
+							 fastApiCalls(true),
+							 codeCache(true),
+							 snapshot("flint.snapshot"),
+							 microtaskBudget(0)
 		{
 		}
 
@@ -31,6 +37,13 @@ namespace flint
 		EngineState state;
 		char* commandLine;
 		std::wstring main;
+		bool fastApiCalls;
+		bool codeCache;			// compiled module code is cached next to the sources
+		std::string snapshot;	// startup snapshot, used when present and compatible; relative to the executable
+		std::string makeSnapshot;	// writes the snapshot to this path instead of running
+		std::string cpuProfile;		// CPU profile of the whole run, written on exit
+		std::string heapProfile;	// sampled allocations of the whole run, written on exit
+		float microtaskBudget;		// ms per tick for microtask checkpoints after the first, 0 for no limit
 	};
 
 	class Engine : protected IEngineEventListener
@@ -47,9 +60,10 @@ namespace flint
 
 		static Engine* Create(const EngineParameters& params = EngineParameters());
 		static Engine* Get();
+		static bool isDebug() { return m_bDebug; }
 		void release();
 		bool initialize();
-		void run();
+		int run();
 		void quit();
 		void close();
 		EngineParameters& getParameters();
@@ -72,10 +86,28 @@ namespace flint
 
 	private:
 
+		bool present();
+		void wait();
+		double getTimeout() const;
+		void reportStats(float delta);
+		int runBenchmark();
+
 		EngineParameters		m_params;
+		FrameStats				m_statsTotal;
+		float					m_fStatsTime;
+		float					m_fStatsWorst;
+		float					m_fStatsUnpresented;	// script and layout ms of ticks without a frame
+		uint32_t				m_nStatsFrames;
+		GCStats					m_gcReported;	// collections up to the last report
+		std::chrono::steady_clock::time_point	m_loadTime;
+		std::chrono::steady_clock::time_point	m_nextFrame;
+		std::chrono::steady_clock::duration		m_frameInterval;
+		double					m_fFrameTime;	// target time of the last frame in ms
 		Renderer*				m_pRenderer;
 		javascript::Interface*	m_pScriptInterface;
 		platform::Window*		m_pWindow;
+		Benchmark*				m_pBenchmark;
+		bool					m_bQuit;
 		static Engine*			m_spInstance;
 		static bool				m_bDebug;
 	};
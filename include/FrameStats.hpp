@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+namespace flint
+{
+
+	struct FrameStats
+	{
+		FrameStats() : visited(0),
+					   culled(0),
+					   clipped(0),
+					   drawn(0),
+					   dirtyRects(0),
+					   dirtyArea(0),
+					   stateOps(0),
+					   textDraws(0),
+					   imageDraws(0),
+					   microtaskCheckpoints(0),
+					   microtaskDeferrals(0),
+					   queuedMicrotasks(0),
+					   script(0),
+					   layout(0),
+					   raster(0),
+					   flush(0),
+					   present(0),
+					   microtasks(0)
+		{
+		}
+
+		float getTotal() const { return script + layout + raster + flush + present; }
+
+		uint32_t visited;		// elements reached by the render walk
+		uint32_t culled;		// visible but outside every dirty rectangle
+		uint32_t clipped;		// outside the parent or window bounds
+		uint32_t drawn;
+		uint32_t dirtyRects;
+		uint64_t dirtyArea;		// pixels
+		uint32_t stateOps;		// canvas save, restore, clip and matrix changes
+		uint32_t textDraws;
+		uint32_t imageDraws;
+		uint32_t microtaskCheckpoints;
+		uint32_t microtaskDeferrals;	// checkpoints skipped over the budget
+		uint32_t queuedMicrotasks;		// queueMicrotask calls
+		float script;			// milliseconds
+		float layout;
+		float raster;
+		float flush;
+		float present;
+		float microtasks;		// part of script
+	};
+
+	// Parts of a tick, marked in CPU profiles.
+	enum class FramePhase : uint8_t
+	{
+		SCRIPT,
+		RENDER,
+		IDLE
+	};
+
+	// Garbage collection pauses by when they happened: during the script
+	// work of a tick, in idle time handed to V8 or elsewhere, e.g. in input
+	// handlers. Times are milliseconds.
+	struct GCStats
+	{
+		GCStats() : frame(0),
+					idle(0),
+					other(0),
+					frameTime(0),
+					idleTime(0),
+					otherTime(0)
+		{
+		}
+
+		uint32_t frame;
+		uint32_t idle;
+		uint32_t other;
+		float frameTime;
+		float idleTime;
+		float otherTime;
+	};
+
+	class Stopwatch
+	{
+	public:
+
+		Stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+
+		// Milliseconds since construction or the previous lap.
+		float lap()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			const std::chrono::duration<float, std::milli> elapsed = now - m_start;
+			m_start = now;
+			return elapsed.count();
+		}
+
+	private:
+
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+}
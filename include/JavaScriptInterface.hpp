@@ -1,10 +1,12 @@
 #pragma once
 
+#include "FrameStats.hpp"
 #include <cstdint>
 
 namespace flint
 {
 	class Engine;
+	struct EngineParameters;
 
 	namespace javascript
 	{
@@ -17,9 +19,32 @@ namespace flint
 			Interface(Engine& engine);
 			~Interface();
 
+			// Writes a startup snapshot of the bindings, run instead of an
+			// application.
+			static bool createSnapshot(const EngineParameters& params, const char* path);
+
 			bool initialize(const wchar_t* main);
 			void load();
+			// Runs the per tick script work: imports, update callbacks and
+			// timers. Returns isAnimating().
 			bool update(float delta);
+			// Runs the animation frame callbacks before the frame is laid
+			// out, timestamp is the frame's target time in milliseconds.
+			void animate(double timestamp);
+			// True while the script needs frames regardless of damage.
+			bool isAnimating() const;
+			// Milliseconds until the next script timer is due, negative
+			// when none is scheduled.
+			double getTimeout() const;
+			// Offers budget milliseconds of idle time to the garbage
+			// collector, budgets too short for it are skipped. bUntilInput
+			// when nothing is scheduled and the application sleeps until
+			// input, budget is then ignored. Returns true while there is
+			// more idle work.
+			bool idle(double budget, bool bUntilInput);
+			const GCStats& getGCStats() const;
+			// Marks the start of a tick's phase in a running CPU profile.
+			void mark(FramePhase phase);
 			bool beforeUnload();
 			void unload();
 			bool event(uint8_t type, uint8_t, const wchar_t*, uint8_t);
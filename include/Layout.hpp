@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Types.hpp"
+#include "Memory.hpp"
+
+namespace flint
+{
+	class IRenderElement;
+
+	// Flex container and item properties of an element. Allocated on demand,
+	// elements that never take part in flex layout don't pay for it.
+	struct FlexStyle
+	{
+		enum class Direction : uint8_t
+		{
+			NONE = 0,
+			ROW,
+			COLUMN,
+			ROW_REVERSE,
+			COLUMN_REVERSE
+		};
+
+		enum class Justify : uint8_t
+		{
+			START = 0,
+			END,
+			CENTER,
+			SPACE_BETWEEN,
+			SPACE_AROUND,
+			SPACE_EVENLY
+		};
+
+		enum class Align : uint8_t
+		{
+			AUTO = 0,
+			START,
+			END,
+			CENTER,
+			STRETCH
+		};
+
+		static void* operator new(size_t size)
+		{
+			return memory::allocate(size);
+		}
+
+		static void operator delete(void* p, size_t size)
+		{
+			memory::deallocate(p, size);
+		}
+
+		explicit FlexStyle(const Size& sz) : size(sz),
+											 basis(-1),
+											 grow(0),
+											 shrink(1),
+											 gap(0),
+											 padding{ 0, 0, 0, 0 },
+											 direction(Direction::NONE),
+											 justify(Justify::START),
+											 alignItems(Align::STRETCH),
+											 alignSelf(Align::AUTO),
+											 bWrap(false),
+											 bMeasured(false)
+		{
+		}
+
+		bool isContainer() const { return direction != Direction::NONE; }
+		bool isRow() const { return direction == Direction::ROW || direction == Direction::ROW_REVERSE; }
+		bool isReverse() const { return direction == Direction::ROW_REVERSE || direction == Direction::COLUMN_REVERSE; }
+		bool isAutoSized() const { return size.width == 0 || size.height == 0; }
+
+		Size size;				// preferred size, a zero component is sized by content
+		Size measured;			// cached content size, valid while bMeasured is set
+		int32_t basis;			// main axis base size, negative means use the preferred size
+		float grow;
+		float shrink;
+		uint16_t gap;
+		uint16_t padding[4];	// top, right, bottom, left
+		Direction direction;
+		Justify justify;
+		Align alignItems;
+		Align alignSelf;
+		bool bWrap;
+		bool bMeasured;
+	};
+
+	class FlexLayout
+	{
+	public:
+
+		static void arrange(IRenderElement& container);
+		static Size measure(IRenderElement& element);
+	};
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <new>
+
+namespace flint
+{
+	namespace memory
+	{
+		struct PoolStats
+		{
+			size_t blockSize;
+			size_t live;
+			size_t free;
+			size_t peak;
+		};
+
+		// Fixed block size free-list allocator. Blocks are carved out of slabs
+		// which are kept until trim() releases the unused ones, so once the
+		// working set has been reached allocation and deallocation never touch
+		// the heap. Pools are not thread safe and are only used from the main
+		// thread.
+		class Pool
+		{
+		public:
+
+			explicit Pool(size_t blockSize);
+			~Pool();
+			Pool(const Pool&) = delete;
+			Pool& operator = (const Pool&) = delete;
+
+			void* allocate();
+			void deallocate(void* p);
+			// Releases the slabs without live blocks, returns the bytes freed.
+			size_t trim();
+			const PoolStats& getStats() const { return m_stats; }
+
+		private:
+
+			struct Block
+			{
+				Block* pNext;
+			};
+
+			void grow();
+
+			Block*				m_pFree;
+			size_t				m_nBlocksPerSlab;
+			std::vector<void*>	m_vecSlabs;
+			PoolStats			m_stats;
+		};
+
+		static const size_t GRANULARITY = 16;
+		static const size_t MAX_POOLED_SIZE = 1024;
+		static const size_t POOL_COUNT = MAX_POOLED_SIZE / GRANULARITY;
+
+		void* allocate(size_t size);
+		void deallocate(void* p, size_t size);
+		const PoolStats& getStats(size_t index);
+		// Trims every pool, returns the bytes given back to the heap.
+		size_t trim();
+
+		// Standard allocator front end for containers owned by render elements.
+		template <typename T>
+		class Allocator
+		{
+		public:
+
+			typedef T value_type;
+
+			Allocator() = default;
+			template <typename U> Allocator(const Allocator<U>&) {}
+
+			T* allocate(size_t count)
+			{
+				return static_cast<T*>(memory::allocate(count * sizeof(T)));
+			}
+
+			void deallocate(T* p, size_t count)
+			{
+				memory::deallocate(p, count * sizeof(T));
+			}
+
+			template <typename U> bool operator == (const Allocator<U>&) const { return true; }
+			template <typename U> bool operator != (const Allocator<U>&) const { return false; }
+		};
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace flint
 {
@@ -10,6 +12,26 @@ namespace flint
 	{
 		class Window;
 
+		// Read only view of a whole file.
+		struct MappedFile
+		{
+			const char* data;
+			size_t size;
+		};
+
+		struct FileInfo
+		{
+			uint64_t size;
+			double modified;	// milliseconds since 1970
+			bool bDirectory;
+		};
+
+		struct DirectoryEntry
+		{
+			std::wstring name;
+			bool bDirectory;
+		};
+
 		Window* createWindow(IEngineEventListener* pListener, unsigned int width, unsigned int height, const wchar_t* title);
 		void releaseWindow(Window*& window);
 		bool createOpenGLContext(Window* window);
@@ -22,10 +44,32 @@ namespace flint
 		void closeWindow(Window* window);
 		void quitWindow();
 		void sleep(int ms);
+		// Blocks until a window message arrives or ms elapse, negative
+		// waits without a timeout.
+		void waitForEvents(int ms);
+		// Ends waitForEvents() on the message pump thread, callable from
+		// any thread.
+		void wake();
+		// Refresh rate of the window's display in Hz, 0 when unknown.
+		int getRefreshRate(Window* pWindow);
 		void createConsole(const wchar_t* title);
 		void releaseConsole();
 		std::wstring getCWD();
 		std::wstring getFullPath(const wchar_t* path);
+		// Absolute, normalized form of path, relative paths start in directory.
+		std::wstring resolvePath(const wchar_t* directory, const wchar_t* path);
 		std::wstring getFileName(const wchar_t* path);
+		// Relative paths start in the executable's directory. Narrow like
+		// the paths passed to fopen().
+		std::string resolveExecutablePath(const char* path);
+		size_t getPeakMemoryUsage();
+		MappedFile* mapFile(const wchar_t* path);
+		void unmapFile(MappedFile* pFile);
+		// Reads a whole file into a malloc() block the caller frees, null
+		// when it can't be read. Blocking, meant for I/O threads.
+		char* readFile(const wchar_t* path, size_t& size);
+		bool getFileInfo(const wchar_t* path, FileInfo& info);
+		// Entries of a directory without "." and "..".
+		bool listDirectory(const wchar_t* path, std::vector<DirectoryEntry>& vecEntries);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "include/v8.h"
+#include "include/v8-profiler.h"
+#include "FrameStats.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flint
+{
+	namespace javascript
+	{
+		// CPU and heap profiles of an isolate, written in the formats the
+		// DevTools load: .cpuprofile in the JavaScript Profiler and
+		// Performance panels, .heapprofile and .heapsnapshot in the Memory
+		// panel. Frame markers force a sample at every frame phase and are
+		// written next to the samples as "frames", on the same clock.
+		class Profiler
+		{
+		public:
+
+			Profiler(v8::Isolate* pIsolate, v8::Platform* pPlatform);
+			// Stops the running profiles and writes their files.
+			~Profiler();
+			Profiler(const Profiler&) = delete;
+			Profiler& operator = (const Profiler&) = delete;
+
+			// Profiles are written to path by stop(), false when one is
+			// already running.
+			bool startCpu(const std::string& path);
+			bool startHeapSampling(const std::string& path);
+			// False when a file couldn't be written.
+			bool stop();
+			bool isProfiling() const { return isCpuProfiling() || isHeapSampling(); }
+			bool isCpuProfiling() const { return !m_cpuPath.empty(); }
+			bool isHeapSampling() const { return !m_heapPath.empty(); }
+
+			// Marks the start of a frame phase in the CPU profile. Samples
+			// taken while idle are attributed to (idle).
+			void mark(FramePhase phase);
+
+			static bool writeHeapSnapshot(v8::Isolate* pIsolate, const std::string& path);
+
+		private:
+
+			struct Marker
+			{
+				int64_t time;	// microseconds, the profile's clock
+				uint32_t frame;
+				FramePhase phase;
+			};
+
+			bool writeCpuProfile(const v8::CpuProfile* pProfile);
+			bool writeHeapProfile(v8::AllocationProfile* pProfile);
+
+			v8::Isolate*		m_pIsolate;
+			v8::Platform*		m_pPlatform;
+			v8::CpuProfiler*	m_pCpuProfiler;
+			std::string			m_cpuPath;
+			std::string			m_heapPath;
+			std::vector<Marker>	m_vecMarkers;
+			uint32_t			m_nFrame;
+			bool				m_bIdle;
+		};
+	}
+}
@@ -45,6 +45,13 @@ namespace flint
 			}
 		}
 
+		// True when regions were added or everything was invalidated since
+		// the last update.
+		bool isPending() const
+		{
+			return m_nState != 0;
+		}
+
 		bool isDirty(const Bound& b) const
 		{
 			if (m_nState == 2)
@@ -57,6 +64,19 @@ namespace flint
 			return false;
 		}
 
+		size_t getCount() const
+		{
+			return m_vecRegions.size();
+		}
+
+		uint64_t getArea() const
+		{
+			uint64_t area = 0;
+			for (size_t i = 0; i < m_vecRegions.size(); ++i)
+				area += (uint64_t)(m_vecRegions[i].width() * m_vecRegions[i].height());
+			return area;
+		}
+
 		bool update(SkPath*& pPath)
 		{
 			if (m_nState == 0)
@@ -4,8 +4,10 @@
 #include "Renderer.hpp"
 #include "Border.hpp"
 #include "Image.hpp"
+#include "Memory.hpp"
+#include "Layout.hpp"
 
-#include "include/core/SkM44.h"
+#include "Affine.hpp"
 #include "include/effects/SkImageFilters.h"
 #include "include/effects/SkShaderMaskFilter.h"
 #include <vector>
@@ -27,6 +29,7 @@ namespace flint
 	class IRenderElement
 	{
 		friend class Renderer;
+		friend class FlexLayout;
 
 		enum Flags
 		{
@@ -38,8 +41,23 @@ namespace flint
 			INVALIDATE_ALL = INVALIDATE_TRANSFORM | INVALIDATE_BOUNDS | INVALIDATE_REGION | INVALIDATE_CACHE
 		};
 
+		// Subtrees smaller than this are always walked on the calling thread.
+		static const unsigned int PARALLEL_THRESHOLD = 4096;
+
 	public:
 
+		using Children = std::vector<IRenderElement*, memory::Allocator<IRenderElement*>>;
+
+		static void* operator new(size_t size)
+		{
+			return memory::allocate(size);
+		}
+
+		static void operator delete(void* p, size_t size)
+		{
+			memory::deallocate(p, size);
+		}
+
 		IRenderElement(Renderer& renderer) : m_renderer(renderer),
 											m_pParent(nullptr),
 											m_pCache(nullptr),
@@ -55,7 +73,11 @@ namespace flint
 											m_bDirty(true),
 											m_bClipped(true),
 											m_nFlags(0),
-											m_bVisible(true)
+											m_bVisible(true),
+											m_bInvalidLayout(false),
+											m_bChildLayoutDirty(false),
+											m_pFlex(nullptr),
+											m_nSubtreeSize(1)
 		{
 		}
 
@@ -66,17 +88,53 @@ namespace flint
 			pChild->m_pParent	= this;
 			pChild->m_bClipped	= m_bClipped;
 			m_vecChildren.push_back(pChild);
+			for (IRenderElement* pElement = this; pElement; pElement = pElement->m_pParent)
+				pElement->m_nSubtreeSize += pChild->m_nSubtreeSize;
 			pChild->invalidateTransform();
 			pChild->invalidateRegion();
+			// A child invalidated before it was attached has not told its
+			// new ancestors yet, invalidateLayout() won't do it again.
+			if (pChild->m_bInvalidLayout || pChild->m_bChildLayoutDirty)
+			{
+				for (IRenderElement* pElement = this; pElement && !pElement->m_bChildLayoutDirty; pElement = pElement->m_pParent)
+					pElement->m_bChildLayoutDirty = true;
+				m_renderer.invalidateLayout();
+			}
+			if (isFlexContainer())
+			{
+				pChild->getFlex();
+				invalidateLayout();
+			}
 		}
 
 		void remove(IRenderElement* pChild)
 		{
 			auto itr = std::find(m_vecChildren.cbegin(), m_vecChildren.cend(), pChild);
 			m_vecChildren.erase(itr);
+			for (IRenderElement* pElement = this; pElement; pElement = pElement->m_pParent)
+				pElement->m_nSubtreeSize -= pChild->m_nSubtreeSize;
 			pChild->invalidateRegion();
 			pChild->m_pParent = nullptr;
 			pChild->m_bClipped = true;
+			if (isFlexContainer())
+				invalidateLayout();
+		}
+
+		IRenderElement* getParent() const
+		{
+			return m_pParent;
+		}
+
+		const Children& getChildren() const
+		{
+			return m_vecChildren;
+		}
+
+		// Approximate native bytes held by the element itself, reported to
+		// the script engine so its collector accounts for them.
+		size_t getMemoryUsage() const
+		{
+			return sizeof(IRenderElement) + (m_pFlex ? sizeof(FlexStyle) : 0) + m_vecChildren.capacity() * sizeof(IRenderElement*);
 		}
 
 		const Size& getSize() const
@@ -85,11 +143,26 @@ namespace flint
 		}
 
 		virtual void setSize(const Size& size)
+		{
+			if (m_pFlex && m_pFlex->size != size)
+			{
+				m_pFlex->size = size;
+				invalidateFlex();
+			}
+			resize(size);
+		}
+
+		void resize(const Size& size)
 		{
 			if (m_rect.size != size)
 			{
 				m_bClipped = !(m_bVisible && m_pParent);
 				m_rect.size = size;
+				if (m_fRotation != 0)
+				{
+					updateTransform();
+					invalidateTransform();
+				}
 				invalidateRegion();
 			}
 		}
@@ -103,15 +176,19 @@ namespace flint
 		{
 			if (m_rect.position != position)
 			{
-				m_transform.setRC(0, 3, position.x);
-				m_transform.setRC(1, 3, position.y);
 				m_rect.position = position;
+				updateTransform();
 				invalidateTransform();
 				m_bClipped = !(m_bVisible && m_pParent);
 				invalidateRegion();
 			}
 		}
 
+		const Color& getBackgroundColor() const
+		{
+			return m_backgroundColor;
+		}
+
 		void setBackgroundColor(const Color& color)
 		{
 			m_backgroundColor = color;
@@ -139,6 +216,31 @@ namespace flint
 			return m_scrollPos.x;
 		}
 
+		FlexStyle& getFlex()
+		{
+			if (m_pFlex == nullptr)
+				m_pFlex = new FlexStyle(m_rect.size);
+			return *m_pFlex;
+		}
+
+		bool isFlexContainer() const
+		{
+			return m_pFlex && m_pFlex->isContainer();
+		}
+
+		// Call after changing flex properties of this element.
+		void invalidateFlex()
+		{
+			if (isFlexContainer())
+			{
+				for (size_t i = 0; i < m_vecChildren.size(); ++i)
+					m_vecChildren[i]->getFlex();
+				invalidateLayout();
+			}
+			if (m_pParent && m_pParent->isFlexContainer())
+				m_pParent->invalidateLayout();
+		}
+
 		void invalidateLayout()
 		{
 			if (!m_bInvalidLayout)
@@ -146,11 +248,52 @@ namespace flint
 				m_bInvalidLayout = true;
 				m_bBoundsDirty = true;
 				m_bClipped = false;
+				if (m_pFlex)
+					m_pFlex->bMeasured = false;
+				for (IRenderElement* pParent = m_pParent; pParent && !pParent->m_bChildLayoutDirty; pParent = pParent->m_pParent)
+					pParent->m_bChildLayoutDirty = true;
+				if (m_pFlex && m_pFlex->isAutoSized() && m_pParent && m_pParent->isFlexContainer())
+					m_pParent->invalidateLayout();
 				m_renderer.invalidateLayout();
 				invalidateRegion();
 			}
 		}
 
+		// Lays out dirty flex containers, only descending into subtrees that
+		// were invalidated since the last pass.
+		void layout()
+		{
+			if (m_bInvalidLayout)
+			{
+				m_bInvalidLayout = false;
+				if (isFlexContainer())
+					FlexLayout::arrange(*this);
+			}
+			if (m_bChildLayoutDirty)
+			{
+				m_bChildLayoutDirty = false;
+				size_t dirty = 0;
+				for (size_t i = 0; i < m_vecChildren.size() && dirty < 2; ++i)
+				{
+					IRenderElement* pChild = m_vecChildren[i];
+					if (pChild->m_bInvalidLayout || pChild->m_bChildLayoutDirty)
+						++dirty;
+				}
+				auto function = [](IRenderElement* pChild)
+				{
+					if (pChild->m_bInvalidLayout || pChild->m_bChildLayoutDirty)
+						pChild->layout();
+				};
+				if (dirty > 1)
+					forEachChild(function);
+				else
+				{
+					for (size_t i = 0; i < m_vecChildren.size(); ++i)
+						function(m_vecChildren[i]);
+				}
+			}
+		}
+
 		virtual void invalidateRegion()
 		{
 			if(!m_bDirty && !m_bClipped)
@@ -170,15 +313,12 @@ namespace flint
 			}
 		}
 
-		virtual const SkM44& getGlobalTransform()
+		virtual const Affine& getGlobalTransform()
 		{
 			if (m_bTransformsDirty)
 			{
 				if (m_pParent)
-				{
-					m_transformGlobal = m_pParent->getGlobalTransform();
-					m_transformGlobal.preConcat(m_transform);
-				}
+					m_transformGlobal = m_pParent->getGlobalTransform() * m_transform;
 				else
 					m_transformGlobal = m_transform;
 				m_bTransformsDirty = false;
@@ -211,12 +351,7 @@ namespace flint
 			if (m_fRotation != rotation)
 			{
 				m_fRotation = rotation;
-				m_transform.setRotateUnit({ 0,0,1 }, rotation * 0.01745329251994329f);
-				//m_transform.preScale(2, 2);
-				const float originX = 0.5f * m_rect.size.width;
-				const float originY = 0.5f * m_rect.size.height;
-				m_transform.preTranslate(-originX, -originY);
-				m_transform.postTranslate(m_rect.position.x + originX, m_rect.position.y + originY);
+				updateTransform();
 				if (m_pParent && m_bVisible)
 					m_pParent->invalidate();
 				invalidateTransform();
@@ -230,6 +365,7 @@ namespace flint
 		{
 			if (m_pParent)
 				m_pParent->remove(this);
+			delete m_pFlex;
 		}
 
 		void release()
@@ -307,22 +443,27 @@ namespace flint
 		virtual const Bound& getLocalBounds()
 		{
 			m_localBound = Bound(0, 0, m_rect.size.width, m_rect.size.height);
-			if (m_nOverFlow == OverFlow::VISIBLE)
+			if (m_nOverFlow == OverFlow::VISIBLE && !m_vecChildren.empty())
 			{
+				// Children first, so the batch below is not in use while
+				// recursing and one scratch buffer per thread is enough.
 				for (size_t i = 0; i < m_vecChildren.size(); ++i)
+					m_vecChildren[i]->getLocalBounds();
+				static const size_t BATCH_SIZE = 32;
+				static thread_local Affine transforms[BATCH_SIZE];
+				static thread_local Bound bounds[BATCH_SIZE];
+				for (size_t i = 0; i < m_vecChildren.size(); i += BATCH_SIZE)
 				{
-					Bound bound = m_vecChildren[i]->getLocalBounds();
-					const SkM44 transform = m_vecChildren[i]->m_transform;
-					const SkV3 xDir = transform * SkV3{ (float)bound.getSize().width, 0.0f, 0.0f };
-					const SkV3 yDir = transform * SkV3{ 0.0f, (float)bound.getSize().height, 0.0f };
-					const SkV3 pt = xDir + yDir;
-					const SkV3 pt0 = { (float)bound.left, (float)bound.top, 0 };
-					bound.left = std::min<float>({ pt0.x, xDir.x, yDir.x, pt.x });
-					bound.right = std::max<float>({ pt0.x, xDir.x, yDir.x, pt.x });
-					bound.top = std::min<float>({ pt0.y, xDir.y, yDir.y, pt.y });
-					bound.bottom = std::max<float>({ pt0.y, xDir.y, yDir.y, pt.y });
-					bound.translate(Position(transform.rc(0, 3), transform.rc(1, 3)));
-					m_localBound.unify(bound);
+					const size_t count = std::min(BATCH_SIZE, m_vecChildren.size() - i);
+					for (size_t j = 0; j < count; ++j)
+					{
+						IRenderElement* pChild = m_vecChildren[i + j];
+						bounds[j] = pChild->m_localBound;
+						transforms[j] = pChild->m_transform;
+					}
+					affine::mapBounds(transforms, bounds, bounds, count);
+					for (size_t j = 0; j < count; ++j)
+						m_localBound.unify(bounds[j]);
 				}
 			}
 			return m_localBound;
@@ -333,20 +474,7 @@ namespace flint
 			if (m_bBoundsDirty || m_bTransformsDirty)
 			{
 				m_localBound = getLocalBounds();
-				const SkM44& globalTransform = getGlobalTransform();
-				const SkV3 xDir = globalTransform * SkV3{ 1.0f, 0.0f, 0.0f };
-				const SkV3 yDir = globalTransform * SkV3{ 0.0f, 1.0f, 0.0f };
-				const SkV3 pt0 = xDir * m_localBound.left + yDir * m_localBound.top;
-				const SkV3 pt1 = xDir * m_localBound.right + yDir * m_localBound.top;
-				const SkV3 pt2 = xDir * m_localBound.left + yDir * m_localBound.bottom;
-				const SkV3 pt3 = xDir * m_localBound.right + yDir * m_localBound.bottom;
-
-				m_globalBound.left =  std::min<float>({ pt0.x, pt1.x, pt2.x, pt3.x });
-				m_globalBound.right = std::max<float>({ pt0.x, pt1.x, pt2.x, pt3.x });
-				m_globalBound.top =   std::min<float>({ pt0.y, pt1.y, pt2.y, pt3.y });
-				m_globalBound.bottom = std::max<float>({ pt0.y, pt1.y, pt2.y, pt3.y });
-
-				m_globalBound.translate(Position(globalTransform.rc(0, 3), globalTransform.rc(1, 3)));
+				affine::mapBoundScalar(getGlobalTransform(), m_localBound, m_globalBound);
 				m_bBoundsDirty = false;
 			}
 			return m_globalBound;
@@ -363,7 +491,11 @@ namespace flint
 			{
 				m_bVisible = bVisible;
 				if (m_pParent)
+				{
 					m_pParent->invalidate();
+					if (m_pParent->isFlexContainer())
+						m_pParent->invalidateLayout();
+				}
 			}
 		}
 
@@ -383,6 +515,36 @@ namespace flint
 
 	protected:
 
+		// Runs function on every child, spreading large subtrees across the
+		// renderer's worker threads.
+		template <typename F>
+		void forEachChild(F function)
+		{
+			if (m_nSubtreeSize >= PARALLEL_THRESHOLD && m_vecChildren.size() > 1)
+				m_renderer.parallel(m_vecChildren.data(), m_vecChildren.size(), function);
+			else
+			{
+				for (size_t i = 0; i < m_vecChildren.size(); ++i)
+					function(m_vecChildren[i]);
+			}
+		}
+
+		void updateTransform()
+		{
+			const float x = (float)m_rect.position.x;
+			const float y = (float)m_rect.position.y;
+			if (m_fRotation == 0)
+				m_transform = Affine(1, 0, 0, 1, x, y);
+			else
+			{
+				const float originX = 0.5f * m_rect.size.width;
+				const float originY = 0.5f * m_rect.size.height;
+				m_transform = Affine::Rotation(m_fRotation * 0.01745329251994329f);
+				m_transform.preTranslate(-originX, -originY);
+				m_transform.postTranslate(x + originX, y + originY);
+			}
+		}
+
 		void renderBounds()
 		{
 			//if (!m_bClipped)
@@ -415,8 +577,8 @@ namespace flint
 						m_renderer.addRedrawRegion(m_visibleBounds);
 					if (!m_vecChildren.empty())
 					{
-						for (size_t i = 0; i < m_vecChildren.size(); ++i)
-							m_vecChildren[i]->updateLayout(m_visibleBounds, m_bDirty);
+						const bool bDirty = m_bDirty;
+						forEachChild([this, bDirty](IRenderElement* pChild) { pChild->updateLayout(m_visibleBounds, bDirty); });
 					}
 				}
 			}
@@ -424,10 +586,17 @@ namespace flint
 
 		void render(const Bound& bound, const RedrawRegions& region)
 		{
-			if (!m_bClipped)
+			FrameStats& stats = m_renderer.getStats();
+			++stats.visited;
+			if (m_bClipped)
+				++stats.clipped;
+			else
 			{
-				if (m_bDirty || region.isDirty(m_visibleBounds))
+				if (!m_bDirty && !region.isDirty(m_visibleBounds))
+					++stats.culled;
+				else
 				{
+					++stats.drawn;
 					m_bDirty = false;
 					m_renderer.save();
 					m_renderer.setTransform(m_transformGlobal);
@@ -548,10 +717,10 @@ namespace flint
 		bool m_bBoundsDirty;
 		bool m_bClipped;
 		bool m_bSimple;
-		SkM44 m_transform;
-		SkM44 m_transformGlobal;
+		Affine m_transform;
+		Affine m_transformGlobal;
 		Bound m_globalBound;
-		std::vector<IRenderElement*> m_vecChildren;
+		Children m_vecChildren;
 		IRenderElement* m_pParent;
 		Image* m_pBackgroundImage;
 		Rectangle m_rect;
@@ -567,6 +736,9 @@ namespace flint
 		bool m_bDirty;
 		bool m_bVisible;
 		bool m_bInvalidLayout;
+		bool m_bChildLayoutDirty;
+		FlexStyle* m_pFlex;
+		unsigned int m_nSubtreeSize;
 		unsigned char m_nCacheCounter;
 		OverFlow::Enum m_nOverFlow;
 		Position m_scrollPos;
@@ -4,8 +4,10 @@
 #include "FontManager.hpp"
 #include "Renderer.hpp"
 #include "RedrawRegions.hpp"
+#include "FrameStats.hpp"
 #include <string>
 #include <vector>
+#include <functional>
 
 class SkM44;
 
@@ -18,6 +20,7 @@ namespace flint
 	class Paint;
 	class Context;
 	class Canvas;
+	struct Affine;
 
 	class Renderer
 	{
@@ -29,13 +32,16 @@ namespace flint
 		Renderer& operator = (const Renderer&) = delete;
 
 		bool createContext(const Size& size);
+		bool createRasterContext(const Size& size);
 		const Size& getSize() const { return m_tSize; }
 		Canvas* getCanvas() const { return m_pCanvas; }
 		void setSize(const Size& size);
 		void setClippingRectangle(const Rectangle& rectangle);
 		void setExclusionRectangle(const Rectangle& rectangle);
 		void translate(const Position& position);
+		void transform(const Affine& transform);
 		void transform(const SkM44& transform);
+		void setTransform(const Affine& transform);
 		void setTransform(const SkM44& transform);
 		void rotate(float degree, const Position& position);
 		void invalidate();
@@ -48,6 +54,9 @@ namespace flint
 		unsigned char getAlpha() const;
 		void setAlpha(unsigned char alpha);
 		Stage* getStage() const { return m_pStage; }
+		FrameStats& getStats() { return m_stats; }
+		const FrameStats& getLastFrameStats() const { return m_lastStats; }
+		void endFrame();
 		Font* createFont(const char* family, unsigned short size, Font::Weight weight = Font::Weight::NORMAL);
 		Image* createImage(const char* filename);
 		void setFilter(void* pFilter);
@@ -55,6 +64,10 @@ namespace flint
 		void* createLayer(const Size& size);
 		void* setLayer(void* layer);
 		bool render();
+		bool hasDamage() const;
+		// Bytes held by layers and decoded images.
+		int64_t getExternalMemory() const { return m_nExternalMemory; }
+		void addExternalMemory(int64_t bytes) { m_nExternalMemory += bytes; }
 		void finish();
 		void drawLayer(void* pLayer);
 		void setFont(Font* font);
@@ -66,6 +79,7 @@ namespace flint
 		void draw(const Image& image, const Rectangle& rectangle);
 		void draw(const char* text, const Position& position);
 		void flush();
+		void parallel(IRenderElement* const* ppElements, size_t count, const std::function<void(IRenderElement*)>& function);
 		
 	private:
 
@@ -81,6 +95,10 @@ namespace flint
 		unsigned int					m_nTexture;
 		unsigned int					m_nStencilBuffer;
 		bool							m_bInvalidLayout;
+		std::vector<std::vector<Bound>>	m_vecRegionBuffers;
+		FrameStats						m_stats;
+		FrameStats						m_lastStats;
+		int64_t							m_nExternalMemory;
 	};
 
 }
\ No newline at end of file
@@ -22,6 +22,11 @@ namespace flint
 				m_localBound = Bound(0, 0, size.width, size.height);
 				m_rect.size = size;
 				m_globalBound = m_rect;
+				if (m_pFlex)
+				{
+					m_pFlex->size = size;
+					invalidateLayout();
+				}
 				m_renderer.invalidateLayout();
 				m_renderer.invalidate();
 			}
@@ -29,7 +34,7 @@ namespace flint
 
 		void setPosition(const Position&) {};
 		void setRotation(float rotation) {};
-		const SkM44& getGlobalTransform() {	return m_transformGlobal; }
+		const Affine& getGlobalTransform() {	return m_transformGlobal; }
 		void invalidateTransform() {}
 		void invalidateRegion() { m_renderer.invalidateLayout(); m_renderer.invalidate(); }
 		void invalidateBounds() {}
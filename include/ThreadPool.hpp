@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flint
+{
+
+	// Work stealing thread pool. Every worker owns a deque, it pops its own
+	// tasks from the back and steals from the front of the other deques when
+	// it runs dry. Threads waiting on a group execute pending tasks instead of
+	// blocking, so groups can be nested.
+	class ThreadPool
+	{
+	public:
+
+		using Task = std::function<void()>;
+
+		class Group
+		{
+			friend class ThreadPool;
+
+		public:
+
+			Group() : m_nPending(0) {}
+
+		private:
+
+			std::atomic<unsigned int> m_nPending;
+		};
+
+		explicit ThreadPool(unsigned int threads);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator = (const ThreadPool&) = delete;
+
+		static ThreadPool& Get();
+		// Pool for blocking file I/O and background work of the script
+		// engine, kept apart so that waiting on the disk doesn't hold up
+		// compute tasks and the main thread never runs these tasks while
+		// it waits on the compute pool.
+		static ThreadPool& GetIO();
+
+		// Index of the calling thread, 0 for threads outside the pool and
+		// 1..getThreadCount() for its workers.
+		unsigned int getCurrentIndex() const;
+
+		unsigned int getThreadCount() const { return (unsigned int)m_vecWorkers.size(); }
+		void run(Group& group, Task&& task);
+		void wait(Group& group);
+
+	private:
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<std::pair<Group*, Task>> tasks;
+		};
+
+		bool pop(unsigned int index, std::pair<Group*, Task>& task);
+		void execute(std::pair<Group*, Task>& task);
+		void work(unsigned int index);
+
+		std::vector<std::thread>	m_vecWorkers;
+		std::vector<Queue>			m_vecQueues;
+		std::mutex					m_mutex;
+		std::condition_variable		m_condition;
+		std::atomic<unsigned int>	m_nQueued;
+		bool						m_bQuit;
+	};
+
+}
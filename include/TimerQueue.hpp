@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace flint
+{
+	// Timers ordered by deadline in a binary min-heap on the monotonic clock,
+	// so a frame only touches the timers that are due. Cancelled and
+	// rescheduled timers leave stale heap entries behind which are skipped
+	// when they surface and dropped when they outnumber the live ones.
+	class TimerQueue
+	{
+	public:
+
+		typedef std::chrono::steady_clock Clock;
+
+		TimerQueue();
+		TimerQueue(const TimerQueue&) = delete;
+		TimerQueue& operator = (const TimerQueue&) = delete;
+
+		// Schedules a timer delay milliseconds from now and returns its id,
+		// never 0. Intervals repeat until removed.
+		uint32_t add(double delay, bool bRepeat);
+		bool remove(uint32_t id);
+		bool contains(uint32_t id) const { return m_timers.count(id) != 0; }
+		size_t size() const { return m_timers.size(); }
+
+		// Returns a timer due at now or 0. Only timers scheduled before
+		// getSequence() returned limit are considered, so timers added or
+		// rescheduled by callbacks wait for the next pass. One-shot timers
+		// are removed, intervals move to their next deadline.
+		uint32_t pop(Clock::time_point now, uint64_t limit);
+		uint64_t getSequence() const { return m_nSequence; }
+
+		// Deadline of the earliest timer, false when there are none.
+		bool getNextDeadline(Clock::time_point& deadline);
+
+	private:
+
+		struct Timer
+		{
+			Clock::time_point deadline;
+			Clock::duration interval;
+			uint64_t sequence;
+			bool bRepeat;
+		};
+
+		struct Entry
+		{
+			Clock::time_point deadline;
+			uint64_t sequence;
+			uint32_t id;
+
+			// Orders the heap by deadline, then by scheduling order.
+			bool operator < (const Entry& other) const
+			{
+				return (deadline != other.deadline) ? deadline > other.deadline : sequence > other.sequence;
+			}
+		};
+
+		void push(uint32_t id, Timer& timer);
+		bool isStale(const Entry& entry) const;
+		void compact();
+
+		std::unordered_map<uint32_t, Timer>	m_timers;
+		std::vector<Entry>					m_heap;
+		uint64_t							m_nSequence;
+		uint32_t							m_nLastId;
+	};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace flint
+{
+	// Timeline capture in the Chrome trace event format, load the output in
+	// chrome://tracing or ui.perfetto.dev. Events are complete ("X") events
+	// written to a fixed size ring buffer owned by the recording thread, so
+	// recording never locks and a long capture keeps the most recent events.
+	namespace trace
+	{
+		extern std::atomic<bool> Enabled;
+
+		inline bool isEnabled() { return Enabled.load(std::memory_order_relaxed); }
+
+		// Starts capturing, the file is written by stop().
+		bool start(const char* path);
+		void stop();
+
+		// Nanoseconds since start().
+		uint64_t now();
+
+		// Names are stored by pointer and must outlive the capture, use
+		// intern() for names that don't.
+		void record(const char* name, uint64_t begin, uint64_t end);
+		const char* intern(const char* name);
+		void setThreadName(const char* name);
+
+		// Nested begin/end pairs for callers that can't keep a scope alive,
+		// e.g. calls crossing into JavaScript.
+		void begin(const char* name);
+		void end();
+
+		class Scope
+		{
+		public:
+
+			explicit Scope(const char* name) : m_name(name),
+											   m_nBegin(isEnabled() ? now() : 0)
+			{
+			}
+
+			~Scope()
+			{
+				if (m_nBegin != 0 && isEnabled())
+					record(m_name, m_nBegin, now());
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator = (const Scope&) = delete;
+
+		private:
+
+			const char* m_name;
+			uint64_t m_nBegin;
+		};
+	}
+
+}
+
+#define FLINT_TRACE_CONCAT_(a, b) a##b
+#define FLINT_TRACE_CONCAT(a, b) FLINT_TRACE_CONCAT_(a, b)
+#define FLINT_TRACE_SCOPE(name) flint::trace::Scope FLINT_TRACE_CONCAT(traceScope, __LINE__)(name)
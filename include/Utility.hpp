@@ -3,14 +3,26 @@
 #include <cstring>
 #include <cctype>
 #include <map>
+#ifndef _WIN32
+#include <strings.h>
+#endif
 
 namespace flint
 {
 	namespace utility
 	{
+		inline int compareNoCase(const char* s1, const char* s2)
+		{
+#ifdef _WIN32
+			return _stricmp(s1, s2);
+#else
+			return strcasecmp(s1, s2);
+#endif
+		}
+
 		struct CaseInsensitiveComparator
 		{
-			bool operator() (const char* s1, const char* s2) const	{ return _stricmp(s1, s2); }
+			bool operator() (const char* s1, const char* s2) const	{ return compareNoCase(s1, s2) < 0; }
 		};
 
 		class CommandLineArguments
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "include/v8.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flint
+{
+	namespace javascript
+	{
+		// A script module running in its own isolate on its own thread.
+		// Messages are structured clones written by v8::ValueSerializer,
+		// ArrayBuffers in the transfer list hand their backing store over
+		// without a copy and are detached on the sending side.
+		class Worker
+		{
+		public:
+
+			struct Message
+			{
+				struct Free
+				{
+					void operator () (uint8_t* p) const { free(p); }
+				};
+
+				std::unique_ptr<uint8_t, Free> pData;
+				size_t size;
+				std::vector<std::shared_ptr<v8::BackingStore>> vecBuffers;
+			};
+
+			// Starts the worker on the module at path, an absolute path. The
+			// allocator is the one of the creating isolate: transferred
+			// backing stores keep it as their deleter, so it must outlive
+			// the worker.
+			Worker(v8::Platform* pPlatform, const std::shared_ptr<v8::ArrayBuffer::Allocator>& pAllocator, const std::wstring& path);
+			~Worker();
+			Worker(const Worker&) = delete;
+			Worker& operator = (const Worker&) = delete;
+
+			// Queues a message for the worker's onmessage.
+			void postMessage(Message&& message);
+
+			// Moves the messages the worker posted to out, false when there
+			// were none.
+			bool receive(std::deque<Message>& out);
+
+			// Stops the worker, interrupting a running script, and waits for
+			// its thread. Queued messages are dropped.
+			void terminate();
+
+			// True once the worker's thread finished, by close(), an error
+			// in its module or terminate().
+			bool isClosed() const { return m_bClosed.load(std::memory_order_acquire); }
+
+			// Throws a DataCloneError and returns false when value, or the
+			// transfer list, can't be cloned.
+			static bool serialize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value, v8::Local<v8::Value> transfer, Message& message);
+			static v8::MaybeLocal<v8::Value> deserialize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, Message& message);
+
+		private:
+
+			void run();
+			bool load(v8::Local<v8::Context> context);
+			void dispatch(v8::Local<v8::Context> context, Message& message);
+
+			static void postMessageCallback(const v8::FunctionCallbackInfo<v8::Value>& args);
+			static void closeCallback(const v8::FunctionCallbackInfo<v8::Value>& args);
+			static void printCallback(const v8::FunctionCallbackInfo<v8::Value>& args);
+			static v8::MaybeLocal<v8::Module> resolveModule(v8::Local<v8::Context> context, v8::Local<v8::String> specifier, v8::Local<v8::FixedArray> import_assertions, v8::Local<v8::Module> referrer);
+
+			v8::Platform*				m_pPlatform;
+			std::shared_ptr<v8::ArrayBuffer::Allocator>	m_pAllocator;
+			std::wstring				m_path;
+			v8::Isolate*				m_pIsolate;
+			std::vector<std::pair<v8::Global<v8::Module>, std::wstring>>	m_vecModules;
+			std::deque<Message>			m_inbox;
+			std::deque<Message>			m_outbox;
+			std::mutex					m_mutex;
+			std::condition_variable		m_condition;
+			std::atomic<bool>			m_bClosed;
+			bool						m_bTerminate;
+			bool						m_bClosing;
+			std::thread					m_thread;
+		};
+	}
+}
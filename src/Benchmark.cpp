@@ -0,0 +1,284 @@
+#include "Benchmark.hpp"
+#include "Memory.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+namespace flint
+{
+	namespace
+	{
+		// Differences below this many milliseconds are noise, not regressions.
+		const double MINIMUM_REGRESSION = 0.05;
+
+		struct Summary
+		{
+			double mean, p50, p95, p99, max;
+		};
+
+		Summary summarize(std::vector<float> values)
+		{
+			Summary summary = { 0, 0, 0, 0, 0 };
+			if (values.empty())
+				return summary;
+			std::sort(values.begin(), values.end());
+			double sum = 0;
+			for (size_t i = 0; i < values.size(); ++i)
+				sum += values[i];
+			auto percentile = [&values](double p)
+			{
+				const size_t rank = (size_t)std::ceil(p * values.size());
+				return (double)values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+			};
+			summary.mean = sum / values.size();
+			summary.p50 = percentile(0.50);
+			summary.p95 = percentile(0.95);
+			summary.p99 = percentile(0.99);
+			summary.max = values.back();
+			return summary;
+		}
+
+		void append(std::string& out, const char* format, ...)
+		{
+			char buffer[512];
+			va_list args;
+			va_start(args, format);
+			vsnprintf(buffer, sizeof(buffer), format, args);
+			va_end(args);
+			out += buffer;
+		}
+
+		void appendSummary(std::string& out, const char* name, const Summary& s)
+		{
+			append(out, "\"%s\":{\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}", name, s.mean, s.p50, s.p95, s.p99, s.max);
+		}
+
+		void skipSpace(const char*& p)
+		{
+			while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+				++p;
+		}
+
+		bool parseString(const char*& p, std::string& out)
+		{
+			if (*p++ != '"')
+				return false;
+			for (; *p && *p != '"'; ++p)
+			{
+				if (*p == '\\' && p[1])
+					++p;
+				out += *p;
+			}
+			if (*p != '"')
+				return false;
+			++p;
+			return true;
+		}
+
+		// Flattens the numbers of a JSON document into dotted paths, e.g.
+		// "phases.raster.p95". Only what the comparison needs is kept.
+		bool parseValue(const char*& p, const std::string& path, std::map<std::string, double>& values)
+		{
+			skipSpace(p);
+			if (*p == '{' || *p == '[')
+			{
+				const bool bObject = (*p == '{');
+				const char close = bObject ? '}' : ']';
+				++p;
+				skipSpace(p);
+				for (int index = 0; *p != close; ++index)
+				{
+					std::string key;
+					if (bObject)
+					{
+						if (!parseString(p, key))
+							return false;
+						skipSpace(p);
+						if (*p++ != ':')
+							return false;
+					}
+					else
+						key = std::to_string(index);
+					if (!parseValue(p, path.empty() ? key : path + "." + key, values))
+						return false;
+					skipSpace(p);
+					if (*p == ',')
+					{
+						++p;
+						skipSpace(p);
+					}
+					else if (*p != close)
+						return false;
+				}
+				++p;
+				return true;
+			}
+			if (*p == '"')
+			{
+				std::string ignored;
+				return parseString(p, ignored);
+			}
+			if (*p == '-' || (*p >= '0' && *p <= '9'))
+			{
+				char* end = nullptr;
+				values[path] = strtod(p, &end);
+				p = end;
+				return true;
+			}
+			while ((*p >= 'a' && *p <= 'z'))
+				++p;
+			return true;
+		}
+
+		bool parse(const std::string& json, std::map<std::string, double>& values)
+		{
+			const char* p = json.c_str();
+			return parseValue(p, "", values);
+		}
+
+		bool readFile(const std::string& path, std::string& out)
+		{
+			FILE* file = fopen(path.c_str(), "rb");
+			if (file == nullptr)
+				return false;
+			char buffer[4096];
+			size_t count;
+			while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+				out.append(buffer, count);
+			fclose(file);
+			return true;
+		}
+	}
+
+	Benchmark::Benchmark(const BenchmarkParameters& params) : m_params(params),
+															  m_nFrame(0)
+	{
+		m_vecFrames.reserve(params.frames);
+		m_vecFrameTimes.reserve(params.frames);
+	}
+
+	void Benchmark::record(const FrameStats& stats, float frameTime)
+	{
+		if (m_nFrame++ < WARMUP_FRAMES)
+			return;
+		m_vecFrames.push_back(stats);
+		m_vecFrameTimes.push_back(frameTime);
+	}
+
+	bool Benchmark::finish(const std::string& scene, const Size& size)
+	{
+		const std::string results = toJSON(scene, size);
+		if (m_params.output.empty())
+			printf("%s\n", results.c_str());
+		else
+		{
+			FILE* file = fopen(m_params.output.c_str(), "wb");
+			if (file == nullptr)
+			{
+				printf("Unable to write benchmark results to %s\n", m_params.output.c_str());
+				return false;
+			}
+			fwrite(results.data(), 1, results.size(), file);
+			fclose(file);
+		}
+		return m_params.baseline.empty() || compare(results);
+	}
+
+	std::string Benchmark::toJSON(const std::string& scene, const Size& size) const
+	{
+		static const char* const Phases[] = { "script", "layout", "raster", "flush", "present" };
+		static float FrameStats::* const Members[] = { &FrameStats::script, &FrameStats::layout, &FrameStats::raster, &FrameStats::flush, &FrameStats::present };
+
+		std::string out;
+		std::string name;
+		for (size_t i = 0; i < scene.size(); ++i)
+		{
+			if (scene[i] == '"' || scene[i] == '\\')
+				name += '\\';
+			name += scene[i];
+		}
+		append(out, "{\n\"scene\":\"%s\",\"width\":%u,\"height\":%u,\"frames\":%u,\n", name.c_str(), (unsigned int)size.width, (unsigned int)size.height, (unsigned int)m_vecFrames.size());
+		appendSummary(out, "frame", summarize(m_vecFrameTimes));
+		out += ",\n\"phases\":{";
+		std::vector<float> values(m_vecFrames.size());
+		for (size_t phase = 0; phase < sizeof(Phases) / sizeof(Phases[0]); ++phase)
+		{
+			for (size_t i = 0; i < m_vecFrames.size(); ++i)
+				values[i] = m_vecFrames[i].*Members[phase];
+			if (phase)
+				out += ",";
+			out += "\n";
+			appendSummary(out, Phases[phase], summarize(values));
+		}
+		out += "},\n";
+
+		const double screen = (double)size.width * size.height;
+		uint32_t nDrawn = 0;
+		double rects = 0, area = 0, drawn = 0, culled = 0, visited = 0;
+		std::vector<float> coverage;
+		for (size_t i = 0; i < m_vecFrames.size(); ++i)
+		{
+			const FrameStats& stats = m_vecFrames[i];
+			visited += stats.visited;
+			drawn += stats.drawn;
+			culled += stats.culled;
+			if (stats.dirtyRects)
+			{
+				++nDrawn;
+				rects += stats.dirtyRects;
+				area += (double)stats.dirtyArea;
+				coverage.push_back(screen > 0 ? (float)(stats.dirtyArea / screen) : 0);
+			}
+		}
+		const double frames = std::max<double>((double)m_vecFrames.size(), 1);
+		const Summary dirty = summarize(coverage);
+		append(out, "\"dirty\":{\"framesDrawn\":%u,\"rectsPerFrame\":%.2f,\"areaPerFrame\":%.0f,\"coverageMean\":%.4f,\"coverageP95\":%.4f,\"coverageMax\":%.4f},\n",
+			   nDrawn, rects / std::max<uint32_t>(nDrawn, 1), area / std::max<uint32_t>(nDrawn, 1), dirty.mean, dirty.p95, dirty.max);
+		append(out, "\"elements\":{\"visited\":%.1f,\"drawn\":%.1f,\"culled\":%.1f},\n", visited / frames, drawn / frames, culled / frames);
+
+		size_t poolBytes = 0;
+		for (size_t i = 0; i < memory::POOL_COUNT; ++i)
+		{
+			const memory::PoolStats& stats = memory::getStats(i);
+			poolBytes += stats.peak * stats.blockSize;
+		}
+		append(out, "\"memory\":{\"peak\":%llu,\"elementPools\":%llu}\n}", (unsigned long long)platform::getPeakMemoryUsage(), (unsigned long long)poolBytes);
+		return out;
+	}
+
+	bool Benchmark::compare(const std::string& results) const
+	{
+		std::string baseline;
+		std::map<std::string, double> previous, current;
+		if (!readFile(m_params.baseline, baseline) || !parse(baseline, previous))
+		{
+			printf("Unable to read benchmark baseline %s\n", m_params.baseline.c_str());
+			return false;
+		}
+		parse(results, current);
+		bool bPassed = true;
+		for (auto itr = current.cbegin(); itr != current.cend(); ++itr)
+		{
+			const std::string& key = itr->first;
+			if (key.compare(0, 6, "frame.") != 0 && key.compare(0, 7, "phases.") != 0)
+				continue;
+			if (key.find(".p50") == std::string::npos && key.find(".p95") == std::string::npos && key.find(".p99") == std::string::npos)
+				continue;
+			auto base = previous.find(key);
+			if (base == previous.cend())
+				continue;
+			if (itr->second > base->second * (1.0 + m_params.threshold) && itr->second - base->second > MINIMUM_REGRESSION)
+			{
+				printf("Regression %s: %.3f ms, baseline %.3f ms (+%.1f%%)\n", key.c_str(), itr->second, base->second, 100.0 * (itr->second / base->second - 1.0));
+				bPassed = false;
+			}
+		}
+		return bPassed;
+	}
+
+}
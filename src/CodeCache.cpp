@@ -0,0 +1,95 @@
+#include "CodeCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace flint
+{
+	namespace javascript
+	{
+		namespace
+		{
+			const uint32_t MAGIC = 0x43434C46;	// "FLCC"
+
+			struct Header
+			{
+				uint32_t magic;
+				uint32_t length;
+				uint64_t version;
+				uint64_t source;
+			};
+
+			FILE* openFile(const std::wstring& path, const wchar_t* mode)
+			{
+				FILE* file = nullptr;
+				_wfopen_s(&file, path.c_str(), mode);
+				return file;
+			}
+		}
+
+		CodeCache::CodeCache()
+		{
+			memset(&m_stats, 0, sizeof(m_stats));
+			const char* version = v8::V8::GetVersion();
+			const uint32_t tag = v8::ScriptCompiler::CachedDataVersionTag();
+			m_nVersion = hash(version, strlen(version)) ^ tag;
+		}
+
+		// FNV-1a, fast enough to hash a bundle on every start.
+		uint64_t CodeCache::hash(const void* data, size_t size)
+		{
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+			uint64_t value = 0xCBF29CE484222325ull;
+			for (size_t i = 0; i < size; ++i)
+			{
+				value ^= p[i];
+				value *= 0x100000001B3ull;
+			}
+			return value;
+		}
+
+		std::wstring CodeCache::getCachePath(const std::wstring& path)
+		{
+			return path + L".cache";
+		}
+
+		v8::ScriptCompiler::CachedData* CodeCache::load(const std::wstring& path, uint64_t sourceHash) const
+		{
+			FILE* file = openFile(getCachePath(path), L"rb");
+			if (file == nullptr)
+				return nullptr;
+			Header header;
+			v8::ScriptCompiler::CachedData* pData = nullptr;
+			if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == MAGIC && header.version == m_nVersion && header.source == sourceHash && header.length > 0)
+			{
+				std::unique_ptr<uint8_t[]> buffer(new uint8_t[header.length]);
+				// A short read means a torn write, the entry is rebuilt.
+				if (fread(buffer.get(), 1, header.length, file) == header.length && fgetc(file) == EOF)
+					pData = new v8::ScriptCompiler::CachedData(buffer.release(), (int)header.length, v8::ScriptCompiler::CachedData::BufferOwned);
+			}
+			fclose(file);
+			return pData;
+		}
+
+		bool CodeCache::store(const std::wstring& path, uint64_t sourceHash, v8::Local<v8::Module> module)
+		{
+			std::unique_ptr<v8::ScriptCompiler::CachedData> pData(v8::ScriptCompiler::CreateCodeCache(module->GetUnboundModuleScript()));
+			if (!pData || pData->length <= 0)
+				return false;
+			FILE* file = openFile(getCachePath(path), L"wb");
+			if (file == nullptr)
+				return false;
+			const Header header = { MAGIC, (uint32_t)pData->length, m_nVersion, sourceHash };
+			const bool bWritten = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(pData->data, 1, pData->length, file) == (size_t)pData->length;
+			fclose(file);
+			if (bWritten)
+				++m_stats.written;
+			return bWritten;
+		}
+
+		void CodeCache::report() const
+		{
+			printf("Code cache: %u hits, %u misses (%u rejected), %u written, compile %.2f ms\n", m_stats.hits, m_stats.misses, m_stats.rejected, m_stats.written, m_stats.compileTime);
+		}
+	}
+}
@@ -0,0 +1,159 @@
+#include "CommandBuffer.hpp"
+#include "RenderElement.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace flint
+{
+	namespace
+	{
+		// Words following the opcode: the target id and the operands.
+		const uint32_t Lengths[CommandBuffer::OP_COUNT] = { 0, 3, 3, 2, 2, 2, 2, 2, 2 };
+
+		bool isAncestor(const IRenderElement* pElement, const IRenderElement* pOther)
+		{
+			for (; pOther; pOther = pOther->getParent())
+			{
+				if (pOther == pElement)
+					return true;
+			}
+			return false;
+		}
+	}
+
+	CommandBuffer::CommandBuffer() : m_vecElements(1, nullptr),
+									 m_vecGenerations(1, 0),
+									 m_nExecuted(0),
+									 m_nRemoved(0)
+	{
+	}
+
+	uint32_t CommandBuffer::add(IRenderElement* pElement)
+	{
+		uint32_t index;
+		if (m_vecFree.empty())
+		{
+			if (m_vecElements.size() > INDEX_MASK)
+				return 0;
+			index = (uint32_t)m_vecElements.size();
+			m_vecElements.push_back(pElement);
+			m_vecGenerations.push_back(0);
+		}
+		else
+		{
+			index = m_vecFree.back();
+			m_vecFree.pop_back();
+			m_vecElements[index] = pElement;
+		}
+		return (m_vecGenerations[index] << INDEX_BITS) | index;
+	}
+
+	void CommandBuffer::remove(uint32_t id)
+	{
+		if (id && get(id))
+		{
+			const uint32_t index = id & INDEX_MASK;
+			m_vecElements[index] = nullptr;
+			m_vecGenerations[index] = (m_vecGenerations[index] + 1) & (UINT32_MAX >> INDEX_BITS);
+			m_vecFree.push_back(index);
+		}
+	}
+
+	uint32_t CommandBuffer::execute(uint32_t* pWords, uint32_t capacity)
+	{
+		const uint32_t count = std::min(pWords[0], capacity);
+		if (count <= HEADER_SIZE)
+		{
+			pWords[0] = HEADER_SIZE;
+			return 0;
+		}
+		FLINT_TRACE_SCOPE("CommandBuffer::execute");
+		uint32_t nRejected = (pWords[0] > capacity) ? 1 : 0;
+		uint32_t i = HEADER_SIZE;
+		while (i < count)
+		{
+			const uint32_t op = pWords[i];
+			if (op == 0 || op >= OP_COUNT || i + 1 + Lengths[op] > count)
+			{
+				++nRejected;
+				break;
+			}
+			const uint32_t* pArgs = &pWords[i + 1];
+			i += 1 + Lengths[op];
+			IRenderElement* pElement = get(pArgs[0]);
+			if (pElement == nullptr)
+			{
+				++nRejected;
+				continue;
+			}
+			switch (op)
+			{
+			case SET_POSITION:
+				pElement->setPosition(Position((int32_t)pArgs[1], (int32_t)pArgs[2]));
+				break;
+			case SET_SIZE:
+				if (pArgs[1] > 0xFFFF || pArgs[2] > 0xFFFF)
+				{
+					++nRejected;
+					continue;
+				}
+				pElement->setSize(Size((Size::Type)pArgs[1], (Size::Type)pArgs[2]));
+				break;
+			case SET_BACKGROUND_COLOR:
+				pElement->setBackgroundColor(Color(pArgs[1]));
+				break;
+			case SET_OPACITY:
+				pElement->setOpacity((unsigned char)std::min<uint32_t>(pArgs[1], 255));
+				break;
+			case SET_ROTATION:
+			{
+				float degree;
+				memcpy(&degree, &pArgs[1], sizeof(degree));
+				if (degree != degree)
+				{
+					++nRejected;
+					continue;
+				}
+				pElement->setRotation(degree);
+				break;
+			}
+			case SET_VISIBLE:
+				pElement->setVisibility(pArgs[1] != 0);
+				break;
+			case ADD_CHILD:
+			{
+				IRenderElement* pChild = get(pArgs[1]);
+				if (pChild == nullptr || isAncestor(pChild, pElement))
+				{
+					++nRejected;
+					continue;
+				}
+				pElement->add(pChild);
+				break;
+			}
+			case REMOVE_CHILD:
+			{
+				IRenderElement* pChild = get(pArgs[1]);
+				if (pChild == nullptr || pChild->getParent() != pElement)
+				{
+					++nRejected;
+					continue;
+				}
+				pElement->remove(pChild);
+				++m_nRemoved;
+				break;
+			}
+			}
+			++m_nExecuted;
+		}
+		pWords[0] = HEADER_SIZE;
+		return nRejected;
+	}
+
+	uint32_t CommandBuffer::grow(uint32_t capacity)
+	{
+		return std::min(capacity * 2, MAXIMUM_CAPACITY);
+	}
+
+}
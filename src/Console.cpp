@@ -0,0 +1,262 @@
+#include "Console.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace flint
+{
+	namespace console
+	{
+		namespace
+		{
+			const size_t SLOT_COUNT = 4096;
+			const size_t SLOT_TEXT = 104;
+			// Upper bound of the writer's latency when a wake up is missed.
+			const std::chrono::milliseconds POLL_INTERVAL(10);
+
+			// A message takes consecutive slots, the first one holds its
+			// header. Slots follow the bounded queue scheme by D. Vyukov:
+			// sequence is the position the slot is free for, one more once
+			// written and a lap more once read.
+			struct Slot
+			{
+				std::atomic<uint64_t> sequence;
+				uint64_t time;		// microseconds since start
+				uint32_t length;
+				uint16_t count;
+				Level level;
+				char text[SLOT_TEXT];
+			};
+
+			std::unique_ptr<Slot[]> Slots;
+			std::atomic<uint64_t> Head(0);
+			uint64_t Tail = 0;
+			std::atomic<uint64_t> Dropped(0);
+			std::atomic<uint8_t> MinimumLevel(0);
+			std::atomic<bool> Running(false);
+			std::atomic<bool> Sleeping(false);
+			bool bStop = false;
+			std::mutex Mutex;
+			std::condition_variable Condition;
+			std::thread Writer;
+			FILE* File = nullptr;
+			const std::chrono::steady_clock::time_point Origin = std::chrono::steady_clock::now();
+
+			uint64_t now()
+			{
+				return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Origin).count();
+			}
+
+			void output(Level level, uint64_t time, const char* text, size_t length)
+			{
+				static const char* const Prefixes[] = { "", "info: ", "warning: ", "error: " };
+				char header[32];
+				const int size = snprintf(header, sizeof(header), "[%10.3f] %s", time / 1000000.0, Prefixes[(int)level]);
+				FILE* files[] = { stdout, File };
+				for (FILE* file : files)
+				{
+					if (file == nullptr)
+						continue;
+					fwrite(header, 1, (size_t)size, file);
+					fwrite(text, 1, length, file);
+					fputc('\n', file);
+				}
+			}
+
+			bool isReady()
+			{
+				return Slots[Tail % SLOT_COUNT].sequence.load(std::memory_order_acquire) == Tail + 1;
+			}
+
+			// Writes the published messages, returns false when there
+			// were none.
+			bool drain()
+			{
+				char text[MAX_MESSAGE];
+				bool bWritten = false;
+				while (isReady())
+				{
+					const Slot& first = Slots[Tail % SLOT_COUNT];
+					const size_t count = first.count;
+					const size_t length = first.length;
+					for (size_t i = 0; i < count; ++i)
+					{
+						Slot& slot = Slots[(Tail + i) % SLOT_COUNT];
+						// The producer publishes the slots one by one.
+						while (slot.sequence.load(std::memory_order_acquire) != Tail + i + 1)
+							std::this_thread::yield();
+						memcpy(text + i * SLOT_TEXT, slot.text, std::min(SLOT_TEXT, length - i * SLOT_TEXT));
+					}
+					output(first.level, first.time, text, length);
+					for (size_t i = 0; i < count; ++i)
+						Slots[(Tail + i) % SLOT_COUNT].sequence.store(Tail + i + SLOT_COUNT, std::memory_order_release);
+					Tail += count;
+					bWritten = true;
+				}
+				return bWritten;
+			}
+
+			void run()
+			{
+				trace::setThreadName("Console");
+				uint64_t nReported = 0;
+				while (true)
+				{
+					bool bWritten = drain();
+					const uint64_t nDropped = Dropped.load(std::memory_order_relaxed);
+					if (nDropped != nReported)
+					{
+						char text[64];
+						const int length = snprintf(text, sizeof(text), "%llu messages dropped, the console is too slow", (unsigned long long)(nDropped - nReported));
+						output(Level::WARN, now(), text, (size_t)length);
+						nReported = nDropped;
+						bWritten = true;
+					}
+					if (bWritten)
+					{
+						fflush(stdout);
+						if (File)
+							fflush(File);
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(Mutex);
+					if (bStop)
+						break;
+					Sleeping.store(true, std::memory_order_seq_cst);
+					Condition.wait_for(lock, POLL_INTERVAL, [] { return bStop || isReady(); });
+					Sleeping.store(false, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool start(const char* path)
+		{
+			if (Running.load())
+				return false;
+			if (path && *path)
+			{
+				File = fopen(path, "wb");
+				if (File == nullptr)
+					printf("Unable to open log file %s\n", path);
+			}
+			Slots.reset(new Slot[SLOT_COUNT]);
+			for (size_t i = 0; i < SLOT_COUNT; ++i)
+				Slots[i].sequence.store(i, std::memory_order_relaxed);
+			Head.store(0, std::memory_order_relaxed);
+			Tail = 0;
+			bStop = false;
+			Running.store(true, std::memory_order_release);
+			Writer = std::thread(run);
+			return true;
+		}
+
+		void stop()
+		{
+			if (!Running.load())
+				return;
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				bStop = true;
+			}
+			Condition.notify_one();
+			Writer.join();
+			// Messages published after the writer's last pass.
+			drain();
+			fflush(stdout);
+			Running.store(false, std::memory_order_release);
+			if (File)
+			{
+				fclose(File);
+				File = nullptr;
+			}
+		}
+
+		void setLevel(Level level)
+		{
+			MinimumLevel.store((uint8_t)level, std::memory_order_relaxed);
+		}
+
+		bool isEnabled(Level level)
+		{
+			return (uint8_t)level >= MinimumLevel.load(std::memory_order_relaxed);
+		}
+
+		bool parseLevel(const char* name, Level& level)
+		{
+			static const char* const Names[] = { "log", "info", "warn", "error" };
+			for (int i = 0; i < 4; ++i)
+			{
+				if (name && strcmp(name, Names[i]) == 0)
+				{
+					level = (Level)i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool write(Level level, const char* text, size_t length)
+		{
+			if (!isEnabled(level))
+				return false;
+			const uint64_t time = now();
+			length = std::min(length, MAX_MESSAGE);
+			if (!Running.load(std::memory_order_acquire))
+			{
+				output(level, time, text, length);
+				fflush(stdout);
+				return true;
+			}
+			const size_t count = std::max<size_t>((length + SLOT_TEXT - 1) / SLOT_TEXT, 1);
+			// The reader frees slots in order, so when the last slot of the
+			// range is free for this lap all of them are.
+			uint64_t head = Head.load(std::memory_order_relaxed);
+			while (true)
+			{
+				const uint64_t last = head + count - 1;
+				const uint64_t sequence = Slots[last % SLOT_COUNT].sequence.load(std::memory_order_acquire);
+				if (sequence == last)
+				{
+					if (Head.compare_exchange_weak(head, head + count, std::memory_order_relaxed))
+						break;
+				}
+				else if (sequence < last)
+				{
+					Dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				else
+					head = Head.load(std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				Slot& slot = Slots[(head + i) % SLOT_COUNT];
+				if (i == 0)
+				{
+					slot.time = time;
+					slot.length = (uint32_t)length;
+					slot.count = (uint16_t)count;
+					slot.level = level;
+				}
+				memcpy(slot.text, text + i * SLOT_TEXT, std::min(SLOT_TEXT, length - i * SLOT_TEXT));
+				slot.sequence.store(head + i + 1, std::memory_order_release);
+			}
+			if (Sleeping.load(std::memory_order_seq_cst))
+				Condition.notify_one();
+			return true;
+		}
+
+		uint64_t getDropped()
+		{
+			return Dropped.load(std::memory_order_relaxed);
+		}
+	}
+
+}
@@ -3,11 +3,31 @@
 #include "Platform.hpp"
 #include "Utility.hpp"
 #include "Renderer.hpp"
+#include "Trace.hpp"
+#include "Benchmark.hpp"
+#include "Console.hpp"
 #include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <map>
 
 namespace flint
 {
+	namespace
+	{
+		// Frame rate used when the display's refresh rate is unknown.
+		const int DEFAULT_REFRESH_RATE = 60;
+		// Idle time left to the garbage collector ends this early, in ms,
+		// so the wait that follows isn't overrun.
+		const double IDLE_MARGIN = 1.0;
+
+		double toMilliseconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<double, std::milli>(duration).count();
+		}
+	}
 
 	Engine* Engine::m_spInstance = nullptr;
 	bool Engine::m_bDebug = false;
@@ -15,7 +35,14 @@ namespace flint
 	Engine::Engine(const EngineParameters& params) : m_params(params),
 													 m_pWindow(nullptr),
 													 m_pRenderer(nullptr),
-													 m_pScriptInterface(nullptr)
+													 m_pScriptInterface(nullptr),
+													 m_pBenchmark(nullptr),
+													 m_bQuit(false),
+													 m_fStatsTime(0),
+													 m_fStatsWorst(0),
+													 m_fStatsUnpresented(0),
+													 m_nStatsFrames(0),
+													 m_fFrameTime(0)
 	{
 	}
 	
@@ -27,6 +54,7 @@ namespace flint
 			platform::releaseWindow(m_pWindow);
 		if (m_pScriptInterface)
 			delete m_pScriptInterface;
+		delete m_pBenchmark;
 	}
 
 	Engine* Engine::Create(const EngineParameters& params)
@@ -34,17 +62,77 @@ namespace flint
 		if (m_spInstance == nullptr)
 		{
 			m_spInstance = new Engine(params);
+			// The default snapshot is written by the build next to the
+			// executable, --snapshot paths are relative to the working
+			// directory.
+			if (!params.snapshot.empty())
+				m_spInstance->m_params.snapshot = platform::resolveExecutablePath(params.snapshot.c_str());
 			if (params.commandLine && params.commandLine[0] != 0)
 			{
 				utility::CommandLineArguments options(params.commandLine);
 				m_bDebug = options.has("--debug");
+				if (options.has("--no-fast-api"))
+					m_spInstance->m_params.fastApiCalls = false;
+				if (options.has("--no-code-cache"))
+					m_spInstance->m_params.codeCache = false;
+				const char* budget = options.get("--microtask-budget");
+				if (budget && atof(budget) > 0.0)
+					m_spInstance->m_params.microtaskBudget = (float)atof(budget);
+				const char* snapshot = options.get("--snapshot");
+				if (snapshot)
+					m_spInstance->m_params.snapshot = snapshot;
+				if (options.has("--make-snapshot"))
+				{
+					snapshot = options.get("--make-snapshot");
+					m_spInstance->m_params.makeSnapshot = (snapshot && *snapshot) ? snapshot : m_spInstance->m_params.snapshot;
+					if (!m_bDebug)
+						platform::createConsole(L"Flint Snapshot");
+				}
 				if (m_bDebug)
 					platform::createConsole(L"Flint Console");
+				if (options.has("--cpu-profile"))
+				{
+					const char* path = options.get("--cpu-profile");
+					m_spInstance->m_params.cpuProfile = (path && *path) ? path : "flint.cpuprofile";
+				}
+				if (options.has("--heap-sample"))
+				{
+					const char* path = options.get("--heap-sample");
+					m_spInstance->m_params.heapProfile = (path && *path) ? path : "flint.heapprofile";
+				}
+				console::Level level;
+				if (console::parseLevel(options.get("--log-level"), level))
+					console::setLevel(level);
+				console::start(options.get("--log-file"));
+				if (trace::start(options.get("--trace")))
+					trace::setThreadName("Main");
 				if (params.main.empty())
 				{
 					const std::string option = options.get("--main");
 					m_spInstance->m_params.main = std::wstring(option.cbegin(), option.cend());
 				}
+				const char* scene = options.get("--bench");
+				if (scene && *scene)
+				{
+					BenchmarkParameters bench;
+					const char* value;
+					if ((value = options.get("--frames")) && atoi(value) > 0)
+						bench.frames = (uint32_t)atoi(value);
+					if ((value = options.get("--threshold")) && *value)
+						bench.threshold = (float)atof(value);
+					if ((value = options.get("--output")))
+						bench.output = value;
+					if ((value = options.get("--baseline")))
+						bench.baseline = value;
+					unsigned int width = 0, height = 0;
+					if ((value = options.get("--size")) && sscanf(value, "%ux%u", &width, &height) == 2 && width && height)
+						m_spInstance->m_params.size = Size((Size::Type)width, (Size::Type)height);
+					const std::string main(scene);
+					m_spInstance->m_params.main = std::wstring(main.cbegin(), main.cend());
+					m_spInstance->m_pBenchmark = new Benchmark(bench);
+					if (!m_bDebug)
+						platform::createConsole(L"Flint Benchmark");
+				}
 			}
 			if(m_spInstance->m_params.main.empty())
 				m_spInstance->m_params.main = L"main.js";
@@ -57,20 +145,29 @@ namespace flint
 
 	void Engine::release()
 	{
+		trace::stop();
+		const bool bConsole = m_bDebug || m_spInstance->m_pBenchmark || !m_spInstance->m_params.makeSnapshot.empty();
 		delete m_spInstance;
 		m_spInstance = nullptr;
-		if (m_bDebug)
+		// Script workers write to the console until the instance joined
+		// them.
+		console::stop();
+		if (bConsole)
 			platform::releaseConsole();
 	}
 	
 	bool Engine::initialize()
 	{
+		if (!m_params.makeSnapshot.empty())
+			return true;
 		if (m_pScriptInterface == nullptr)
 		{
 			m_pScriptInterface = new javascript::Interface(*this);
 			m_pRenderer = new Renderer();
 			if (m_pScriptInterface->initialize(m_params.main.c_str()))
 			{
+				if (m_pBenchmark)
+					return m_pRenderer->createRasterContext(m_params.size);
 				m_pWindow = platform::createWindow(this, m_params.size.width, m_params.size.height, m_params.title.c_str());
 				if (m_pWindow && platform::createOpenGLContext(m_pWindow))
 					return m_pRenderer->createContext(m_params.size);
@@ -79,8 +176,12 @@ namespace flint
 		return false;
 	}
 
-	void Engine::run()
+	int Engine::run()
 	{
+		if (!m_params.makeSnapshot.empty())
+			return javascript::Interface::createSnapshot(m_params, m_params.makeSnapshot.c_str()) ? 0 : 1;
+		if (m_pBenchmark)
+			return runBenchmark();
 		assert(m_pWindow);
 		platform::setState(m_pWindow, (int)m_params.state);
 		onLoad();
@@ -90,16 +191,40 @@ namespace flint
 		delete m_pRenderer;
 		m_pRenderer = nullptr;
 		platform::releaseWindow(m_pWindow);
+		return 0;
+	}
+
+	// Plays the scene offscreen with a fixed timestep and reports the frame
+	// times, returns non-zero when the results regressed against the baseline.
+	int Engine::runBenchmark()
+	{
+		const float step = m_pBenchmark->getTimestep();
+		onLoad();
+		while (!m_bQuit && !m_pBenchmark->isDone())
+		{
+			Stopwatch watch;
+			onUpdate(step);
+			const float frameTime = watch.lap();
+			m_pBenchmark->record(m_pRenderer->getLastFrameStats(), frameTime);
+		}
+		onUnload();
+		const std::string scene(m_params.main.cbegin(), m_params.main.cend());
+		return m_pBenchmark->finish(scene, m_params.size) ? 0 : 1;
 	}
 
 	void Engine::quit()
 	{
-		platform::quitWindow();
+		if (m_pBenchmark)
+			m_bQuit = true;
+		else
+			platform::quitWindow();
 	}
 
 	void Engine::close()
 	{
-		if(m_pWindow)
+		if (m_pBenchmark)
+			m_bQuit = true;
+		else if(m_pWindow)
 			platform::closeWindow(m_pWindow);
 	}
 
@@ -115,9 +240,12 @@ namespace flint
 
 	void Engine::setSize(const Size& size)
 	{
-		assert(m_pWindow && m_pRenderer->isValid());
-		if (m_params.size != size)
+		if (m_params.size == size)
+			return;
+		if (m_pWindow)
 			platform::setSize(m_pWindow, size.width, size.height);
+		else
+			onResize(size);
 	}
 
 	const wchar_t* Engine::getTitle() const
@@ -127,9 +255,9 @@ namespace flint
 
 	void Engine::setTitle(const wchar_t* title)
 	{
-		assert(m_pWindow);
 		m_params.title = title;
-		platform::setTitle(m_pWindow, title);
+		if (m_pWindow)
+			platform::setTitle(m_pWindow, title);
 	}
 
 	EngineState Engine::getState() const
@@ -139,11 +267,11 @@ namespace flint
 
 	void Engine::setState(EngineState state)
 	{
-		assert(m_pWindow);
 		if (m_params.state != state)
 		{
 			m_params.state = state;
-			platform::setState(m_pWindow, (int)state);
+			if (m_pWindow)
+				platform::setState(m_pWindow, (int)state);
 		}
 	}
 
@@ -153,21 +281,162 @@ namespace flint
 		{
 			m_params.size = size;
 			m_pRenderer->setSize(size);
-			if (m_pRenderer->render())
-				platform::swapBuffers(m_pWindow);
+			present();
 		}
 	}
 
+	// Every pump iteration is a tick running timers and update callbacks.
+	// Animation frame callbacks run once per frame interval, and frames are
+	// only rendered when there is damage, so an idle application blocks
+	// until input arrives or a timer is due.
 	void Engine::onUpdate(float delta)
 	{
+		FLINT_TRACE_SCOPE("Engine::onUpdate");
+		typedef std::chrono::steady_clock Clock;
+		Stopwatch watch;
+		m_pScriptInterface->mark(FramePhase::SCRIPT);
 		m_pScriptInterface->update(delta);
+		const Clock::time_point now = Clock::now();
+		// Pacing restarts after idling instead of catching up.
+		if (now - m_nextFrame > m_frameInterval)
+			m_nextFrame = now;
+		const bool bFrameDue = m_pBenchmark || now >= m_nextFrame;
+		if (bFrameDue)
+		{
+			m_fFrameTime = m_pBenchmark ? m_fFrameTime + delta * 1000.0 : toMilliseconds(m_nextFrame - m_loadTime);
+			m_pScriptInterface->animate(m_fFrameTime);
+			m_nextFrame += m_frameInterval;
+			if (m_nextFrame <= now)
+				m_nextFrame = now + m_frameInterval;
+		}
+		m_pRenderer->getStats().script += watch.lap();
+		m_pScriptInterface->mark(FramePhase::RENDER);
+		// Damage from input, timers or messages waits for the next frame
+		// slot, so animation frame callbacks run before every rendered
+		// frame. Headless runs close every tick as a frame, even when
+		// nothing was drawn, so script and layout time is attributed to the
+		// right frame.
+		const bool bPresented = bFrameDue && m_pRenderer->hasDamage() && present();
+		if (!bPresented && m_pBenchmark)
+			m_pRenderer->endFrame();
+		else if (!bPresented)
+		{
+			// Otherwise the work of ticks that drew nothing is reported on
+			// its own instead of being added to the next frame.
+			FrameStats& stats = m_pRenderer->getStats();
+			m_fStatsUnpresented += stats.script + stats.layout;
+			stats.script = 0;
+			stats.layout = 0;
+			stats.microtasks = 0;
+		}
+		if (m_bDebug)
+			reportStats(delta);
+		if (!m_pBenchmark)
+			wait();
+	}
+
+	// Blocks until the next frame while the script animates or damage is
+	// left, otherwise until the next timer or input. The time until then is
+	// first offered to the garbage collector, so collections land between
+	// frames instead of in the middle of one.
+	void Engine::wait()
+	{
+		double timeout = getTimeout();
+		const bool bUntilInput = timeout < 0.0;
+		const bool bMoreIdleWork = m_pScriptInterface->idle(bUntilInput ? 0.0 : timeout - IDLE_MARGIN, bUntilInput);
+		// Without a deadline the collector gets its time in slices, ticks
+		// keep coming until it is done.
+		timeout = (bMoreIdleWork && timeout < 0.0) ? 0.0 : getTimeout();
+		FLINT_TRACE_SCOPE("Engine::wait");
+		m_pScriptInterface->mark(FramePhase::IDLE);
+		platform::waitForEvents((timeout < 0.0) ? -1 : (int)std::ceil(timeout));
+	}
+
+	// Milliseconds until the next frame or script timer, negative when
+	// nothing is scheduled.
+	double Engine::getTimeout() const
+	{
+		double timeout = m_pScriptInterface->getTimeout();
+		if (m_pScriptInterface->isAnimating() || m_pRenderer->hasDamage())
+		{
+			const double frame = std::max(toMilliseconds(m_nextFrame - std::chrono::steady_clock::now()), 0.0);
+			timeout = (timeout < 0.0) ? frame : std::min(timeout, frame);
+		}
+		return timeout;
+	}
+
+	bool Engine::present()
+	{
 		if (m_pRenderer->render())
-			platform::swapBuffers(m_pWindow);
-		platform::sleep(3);
+		{
+			Stopwatch watch;
+			if (m_pWindow)
+			{
+				FLINT_TRACE_SCOPE("swapBuffers");
+				platform::swapBuffers(m_pWindow);
+			}
+			m_pRenderer->getStats().present += watch.lap();
+			m_pRenderer->endFrame();
+			if (m_bDebug)
+			{
+				const FrameStats& stats = m_pRenderer->getLastFrameStats();
+				m_statsTotal.visited += stats.visited;
+				m_statsTotal.culled += stats.culled;
+				m_statsTotal.clipped += stats.clipped;
+				m_statsTotal.drawn += stats.drawn;
+				m_statsTotal.dirtyRects += stats.dirtyRects;
+				m_statsTotal.dirtyArea += stats.dirtyArea;
+				m_statsTotal.stateOps += stats.stateOps;
+				m_statsTotal.textDraws += stats.textDraws;
+				m_statsTotal.imageDraws += stats.imageDraws;
+				m_statsTotal.script += stats.script;
+				m_statsTotal.microtasks += stats.microtasks;
+				m_statsTotal.microtaskDeferrals += stats.microtaskDeferrals;
+				m_statsTotal.layout += stats.layout;
+				m_statsTotal.raster += stats.raster;
+				m_statsTotal.flush += stats.flush;
+				m_statsTotal.present += stats.present;
+				m_fStatsWorst = std::max(m_fStatsWorst, stats.getTotal());
+				++m_nStatsFrames;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Prints averages of the frames presented during the last second, the
+	// script and layout time of ticks that presented nothing and the
+	// garbage collections since the previous report.
+	void Engine::reportStats(float delta)
+	{
+		m_fStatsTime += delta;
+		if (m_fStatsTime < 1.0f)
+			return;
+		const GCStats& gc = m_pScriptInterface->getGCStats();
+		if (m_nStatsFrames)
+		{
+			const FrameStats& s = m_statsTotal;
+			const float n = (float)m_nStatsFrames;
+			printf("%u fps | script %.2f layout %.2f raster %.2f flush %.2f present %.2f worst %.2f ms | between frames %.2f ms | drawn %.0f culled %.0f clipped %.0f of %.0f | %.0f text %.0f images | %.1f rects %.0f px | %.0f state ops | microtasks %.2f ms %u deferred | gc %u in frame %.2f ms %u idle %u other\n",
+				   m_nStatsFrames, s.script / n, s.layout / n, s.raster / n, s.flush / n, s.present / n, m_fStatsWorst, m_fStatsUnpresented,
+				   s.drawn / n, s.culled / n, s.clipped / n, s.visited / n, s.textDraws / n, s.imageDraws / n, s.dirtyRects / n, s.dirtyArea / n, s.stateOps / n, s.microtasks / n, s.microtaskDeferrals,
+				   gc.frame - m_gcReported.frame, gc.frameTime - m_gcReported.frameTime, gc.idle - m_gcReported.idle, gc.other - m_gcReported.other);
+		}
+		m_gcReported = gc;
+		m_statsTotal = FrameStats();
+		m_fStatsTime = 0;
+		m_fStatsWorst = 0;
+		m_fStatsUnpresented = 0;
+		m_nStatsFrames = 0;
 	}
 
 	void Engine::onLoad()
 	{
+		const int rate = m_pWindow ? platform::getRefreshRate(m_pWindow) : 0;
+		m_frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / (rate ? rate : DEFAULT_REFRESH_RATE)));
+		m_loadTime = std::chrono::steady_clock::now();
+		m_nextFrame = m_loadTime;
+		m_fFrameTime = 0;
 		m_pScriptInterface->load();
 	}
 
@@ -1,4 +1,5 @@
 #include "Image.hpp"
+#include "Renderer.hpp"
 #include "include/core/SkImage.h"
 
 namespace flint
@@ -7,7 +8,11 @@ namespace flint
 	Image::~Image()
 	{
 		if (m_pImage)
-			((SkImage*)m_pImage)->unref();
+		{
+			SkImage* pImage = (SkImage*)m_pImage;
+			m_renderer.addExternalMemory(-(int64_t)pImage->width() * pImage->height() * 4);
+			pImage->unref();
+		}
 	}
 
 
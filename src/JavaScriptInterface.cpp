@@ -2,22 +2,110 @@
 #include "libplatform/libplatform.h"
 #include "include/v8.h"
 #include "include/v8-fast-api-calls.h"
+#include "Binding.hpp"
+#include "CommandBuffer.hpp"
+#include "CodeCache.hpp"
+#include "Console.hpp"
+#include <algorithm>
 #include <cstdio>
-#include <map>
-#include <stack>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+#include <cwctype>
 #include <functional>
 #include "Engine.hpp"
 #include "Types.hpp"
 #include "Platform.hpp"
 #include "FlintModule.hpp"
+#include "Profiler.hpp"
+#include "Memory.hpp"
 #include "RenderElement.hpp"
+#include "Renderer.hpp"
+#include "Stage.hpp"
+#include "ThreadPool.hpp"
+#include "TimerQueue.hpp"
+#include "Trace.hpp"
+#include "Worker.hpp"
 #include <windows.h>
 
 namespace flint
 {
 	namespace javascript
 	{
-       
+        namespace binding
+        {
+            template <>
+            struct Range<EngineState>
+            {
+                static bool contains(int32_t value) { return value >= 0 && value <= (int32_t)EngineState::MAXIMIZED; }
+            };
+
+            template <>
+            struct Range<OverFlow::Enum>
+            {
+                static bool contains(int32_t value) { return value >= 0 && value <= (int32_t)OverFlow::SCROLL; }
+            };
+
+            template <>
+            struct Convert<GCStats>
+            {
+                static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const GCStats& stats)
+                {
+                    v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                    v8::Local<v8::Object> result = v8::Object::New(pIsolate);
+                    auto set = [&](const char* name, double value)
+                    {
+                        result->Set(context, v8::String::NewFromUtf8(pIsolate, name).ToLocalChecked(), v8::Number::New(pIsolate, value)).Check();
+                    };
+                    set("frame", stats.frame);
+                    set("idle", stats.idle);
+                    set("other", stats.other);
+                    set("frameTime", stats.frameTime);
+                    set("idleTime", stats.idleTime);
+                    set("otherTime", stats.otherTime);
+                    return result;
+                }
+            };
+
+            // Counters and timings (milliseconds) of a frame, read only.
+            template <>
+            struct Convert<FrameStats>
+            {
+                static v8::Local<v8::Value> to(v8::Isolate* pIsolate, const FrameStats& stats)
+                {
+                    v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                    v8::Local<v8::Object> result = v8::Object::New(pIsolate);
+                    auto set = [&](const char* name, double value)
+                    {
+                        result->Set(context, v8::String::NewFromUtf8(pIsolate, name).ToLocalChecked(), v8::Number::New(pIsolate, value)).Check();
+                    };
+                    set("visited", stats.visited);
+                    set("culled", stats.culled);
+                    set("clipped", stats.clipped);
+                    set("drawn", stats.drawn);
+                    set("dirtyRects", stats.dirtyRects);
+                    set("dirtyArea", (double)stats.dirtyArea);
+                    set("stateOps", stats.stateOps);
+                    set("textDraws", stats.textDraws);
+                    set("imageDraws", stats.imageDraws);
+                    set("microtaskCheckpoints", stats.microtaskCheckpoints);
+                    set("microtaskDeferrals", stats.microtaskDeferrals);
+                    set("queuedMicrotasks", stats.queuedMicrotasks);
+                    set("microtasks", stats.microtasks);
+                    set("script", stats.script);
+                    set("layout", stats.layout);
+                    set("raster", stats.raster);
+                    set("flush", stats.flush);
+                    set("present", stats.present);
+                    set("total", stats.getTotal());
+                    return result;
+                }
+            };
+        }
+
         class Environment
 		{
 			friend class Interface;
@@ -38,78 +126,357 @@ namespace flint
                 return str;
             }
 
-            Environment(Engine& engine) : m_engine(engine), m_pRenderer(nullptr)
-			{
-            
-                //v8::V8::InitializeICUDefaultLocation(argv[0]);
-                //v8::V8::InitializeExternalStartupData(argv[0]);
+            // Indices of the templates stored in the startup snapshot.
+            enum SnapshotData
+            {
+                ELEMENT_TEMPLATE = 0,
+                APPLICATION_TEMPLATE
+            };
 
-                m_pPlatform = v8::platform::NewDefaultPlatform();
-                v8::V8::InitializePlatform(m_pPlatform.get());
-                v8::V8::Initialize();
-                m_currPath.push(platform::getCWD());
-                m_createParams.array_buffer_allocator = v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+            struct SnapshotHeader
+            {
+                uint32_t magic;
+                uint32_t flags;
+                uint64_t version;
+            };
+
+            static const uint32_t SNAPSHOT_MAGIC = 0x53534C46;	// "FLSS"
+
+            Environment(Engine& engine) : m_engine(engine), m_pRenderer(nullptr), m_bFastApi(engine.getParameters().fastApiCalls), m_bCodeCache(engine.getParameters().codeCache), m_pCommands(nullptr), m_nCommandCapacity(0), m_nLastFrameCallback(0), m_bContinuous(false), m_nRemovedChildren(0), m_nLastRemoved(0), m_nRendererMemory(0), m_nReleasedMemory(0), m_gcPhase(GCPhase::OTHER), m_gcStart(0), m_bIdleDone(false), m_bTrimmed(false), m_fMicrotaskTime(0), m_bMicrotasksRan(false), m_bMicrotasksDeferred(false)
+			{
+                m_snapshot.data = nullptr;
+                m_snapshot.raw_size = 0;
+                m_pPlatform = initializeV8(m_bFastApi);
+                m_baseDirectory = platform::getCWD();
+                // Shared with the workers, backing stores moving between the
+                // isolates are freed by the allocator that created them.
+                m_createParams.array_buffer_allocator_shared.reset(v8::ArrayBuffer::Allocator::NewDefaultAllocator());
+                m_createParams.external_references = getExternalReferences(m_bFastApi);
+                const bool bSnapshot = readSnapshot(engine.getParameters().snapshot.c_str(), m_bFastApi, m_snapshot);
+                if (bSnapshot)
+                    m_createParams.snapshot_blob = &m_snapshot;
                 m_pIsolate = v8::Isolate::New(m_createParams);
                 m_pIsolate->SetData(0, this);
+                m_pIsolate->SetHostImportModuleDynamicallyCallback(importModule);
+                // Microtasks run at the checkpoints of a tick rather than
+                // whenever the script stack unwinds.
+                m_pIsolate->SetMicrotasksPolicy(v8::MicrotasksPolicy::kExplicit);
+                m_pIsolate->AddGCPrologueCallback(onGCPrologue, this);
+                m_pIsolate->AddGCEpilogueCallback(onGCEpilogue, this);
 				m_pIsolate->Enter();
 
 				v8::HandleScope handle_scope(m_pIsolate);
-                v8::Local<v8::ObjectTemplate> global = v8::ObjectTemplate::New(m_pIsolate);
-                global->Set(m_pIsolate, "print", v8::FunctionTemplate::New(m_pIsolate, print));
-                global->Set(m_pIsolate, "setInterval", v8::FunctionTemplate::New(m_pIsolate, setInterval));
-                global->Set(m_pIsolate, "setTimeout", v8::FunctionTemplate::New(m_pIsolate, setTimeout));
-                global->Set(m_pIsolate, "clearInterval", v8::FunctionTemplate::New(m_pIsolate, removeTimer));
-                global->Set(m_pIsolate, "clearTimeout", v8::FunctionTemplate::New(m_pIsolate, removeTimer));
-
-                global->Set(m_pIsolate, "__f_init", v8::FunctionTemplate::New(m_pIsolate, __f_init));
-                global->Set(m_pIsolate, "__f_new", v8::FunctionTemplate::New(m_pIsolate, __f_new));
-                global->Set(m_pIsolate, "__f_app", v8::FunctionTemplate::New(m_pIsolate, __f_app));
-                global->Set(m_pIsolate, "__f_elem", v8::FunctionTemplate::New(m_pIsolate, __f_elem));
-
-                v8::Local<v8::ObjectTemplate> containerTemplate = v8::ObjectTemplate::New(m_pIsolate);
-                containerTemplate->SetInternalFieldCount(1);
-                m_elemTemplate.Set(m_pIsolate, containerTemplate);
-
-                v8::Local<v8::Context> context = v8::Context::New(m_pIsolate, nullptr, global);
+                m_pNames = new binding::Names(m_pIsolate);
+                v8::Local<v8::FunctionTemplate> element, application;
+                v8::Local<v8::Context> context;
+                // The snapshot holds the global object with the bindings
+                // already instantiated, only the native pointers are set up
+                // here.
+                if (bSnapshot && m_pIsolate->GetDataFromSnapshotOnce<v8::FunctionTemplate>(ELEMENT_TEMPLATE).ToLocal(&element) &&
+                    m_pIsolate->GetDataFromSnapshotOnce<v8::FunctionTemplate>(APPLICATION_TEMPLATE).ToLocal(&application))
+                    context = v8::Context::New(m_pIsolate);
+                else
+                    context = v8::Context::New(m_pIsolate, nullptr, createGlobal(m_pIsolate, m_bFastApi, element, application));
+                m_elemTemplate.Set(m_pIsolate, element->InstanceTemplate());
 				m_context.Set(m_pIsolate, context);
 				context->Enter();
+
+                v8::Local<v8::Object> app = application->InstanceTemplate()->NewInstance(context).ToLocalChecked();
+                binding::wrap(app, &m_engine);
+                context->Global()->Set(context, v8::String::NewFromUtf8Literal(m_pIsolate, "__app"), app).Check();
+                createCommandBuffer(CommandBuffer::INITIAL_CAPACITY);
+                // Profiles requested on the command line cover the whole
+                // run, loading included.
+                m_pProfiler.reset(new Profiler(m_pIsolate, m_pPlatform.get()));
+                m_pProfiler->startCpu(engine.getParameters().cpuProfile);
+                m_pProfiler->startHeapSampling(engine.getParameters().heapProfile);
 			}
 
 			~Environment()
 			{
+				m_pProfiler.reset();
+				m_commandBuffer.Reset();
+				m_timerCallbacks.clear();
+				m_application.Reset();
+				m_update.Reset();
+				m_load.Reset();
+				m_fireEvent.Reset();
+				m_vecFrameCallbacks.clear();
+				// The renderer is deleted by now, remaining elements are
+				// only forgotten.
+				m_elements.clear();
+				m_orphans.clear();
+				// Worker threads share the platform, stop them first.
+				m_vecWorkers.clear();
+				ThreadPool::GetIO().wait(m_fileRequests);
+				m_vecFileRequests.clear();
+				// Streaming tasks reference their sources, wait before
+				// releasing them with the isolate.
+				ThreadPool::GetIO().wait(m_imports);
+				m_vecImports.clear();
+				m_importErrors.clear();
+				for (auto itr = m_streaming.begin(); itr != m_streaming.end(); ++itr)
+					platform::unmapFile(itr->second->pFile);
+				m_streaming.clear();
+				m_moduleIds.clear();
+				m_modules.clear();
 				m_context.Get(m_pIsolate)->Exit();
 				m_pIsolate->Exit();
 				m_pIsolate->Dispose();
 				v8::V8::Dispose();
 				v8::V8::ShutdownPlatform();
-				delete m_createParams.array_buffer_allocator;
+				delete m_pNames;
+                delete[] m_snapshot.data;
 			}
 
-            v8::MaybeLocal<v8::String> readFile(const wchar_t* name)
+            static std::unique_ptr<v8::Platform> initializeV8(bool bFastApi)
             {
-                FILE* file = nullptr;
-                _wfopen_s(&file, name, L"rb");
-                if (file == NULL)
-                    return v8::MaybeLocal<v8::String>();
+                //v8::V8::InitializeICUDefaultLocation(argv[0]);
+                //v8::V8::InitializeExternalStartupData(argv[0]);
+                if (bFastApi)
+                    v8::V8::SetFlagsFromString("--turbo-fast-api-calls");
+                std::unique_ptr<v8::Platform> pPlatform = v8::platform::NewDefaultPlatform();
+                v8::V8::InitializePlatform(pPlatform.get());
+                v8::V8::Initialize();
+                return pPlatform;
+            }
+
+            static const struct Global
+            {
+                const char* name;
+                v8::FunctionCallback callback;
+            } Globals[], ConsoleMethods[], FileMethods[];
+
+            // Both the element and the application classes are described
+            // once and replayed into binding::Class to build the templates
+            // and into binding::References to list their callbacks.
+            template <typename T>
+            static void describeElement(T& element, bool bFastApi)
+            {
+                // The hot setters also have a fast variant TurboFan calls
+                // directly with unboxed arguments.
+                static const v8::CFunction FastSetPosition = v8::CFunction::Make(fastSetPosition);
+                static const v8::CFunction FastSetOpacity = v8::CFunction::Make(fastSetOpacity);
+                static const v8::CFunction FastSetRotation = v8::CFunction::Make(fastSetRotation);
+                element.property("id", getElementId)
+                       .template property<&IRenderElement::getPosition, &IRenderElement::setPosition>("position")
+                       .template property<&IRenderElement::getSize, &IRenderElement::setSize>("size")
+                       .template property<&IRenderElement::getRotation, &IRenderElement::setRotation>("rotation")
+                       .template property<&getOpacity, &setOpacity>("opacity")
+                       .template property<&IRenderElement::getVisibility, &IRenderElement::setVisibility>("visible")
+                       .template property<&IRenderElement::getOverFlow, &IRenderElement::setOverFlow>("overflow")
+                       .template property<&IRenderElement::getBackgroundColor, &IRenderElement::setBackgroundColor>("backgroundColor")
+                       .template method<&IRenderElement::add>("add")
+                       .template method<&removeChild>("remove")
+                       .method("release", releaseElement)
+                       .method("layout", layoutElement)
+                       .template method<&setPosition>("setPosition", bFastApi ? &FastSetPosition : nullptr)
+                       .template method<&setOpacity>("setOpacity", bFastApi ? &FastSetOpacity : nullptr)
+                       .template method<&IRenderElement::setRotation>("setRotation", bFastApi ? &FastSetRotation : nullptr);
+            }
+
+            template <typename T>
+            static void describeApplication(T& application)
+            {
+                application.template property<&Engine::getTitle, &Engine::setTitle>("title")
+                           .template property<&Engine::getState, &Engine::setState>("state")
+                           .template property<&Engine::getSize, &Engine::setSize>("size")
+                           .template property<&getStats>("stats")
+                           .template property<&getGCStats>("gc")
+                           .template property<&getMicrotaskBudget, &setMicrotaskBudget>("microtaskBudget")
+                           .method("flushCommands", flushCommands)
+                           .method("startProfile", startProfile)
+                           .method("stopProfile", stopProfile)
+                           .method("writeHeapSnapshot", writeHeapSnapshot)
+                           .template method<&Engine::quit>("quit")
+                           .template method<&Engine::close>("close");
+            }
+
+            template <typename T>
+            static void describeWorker(T& worker)
+            {
+                worker.method("postMessage", postWorkerMessage)
+                      .method("terminate", terminateWorker)
+                      .property("closed", isWorkerClosed);
+            }
+
+            static v8::Local<v8::ObjectTemplate> createGlobal(v8::Isolate* pIsolate, bool bFastApi, v8::Local<v8::FunctionTemplate>& element, v8::Local<v8::FunctionTemplate>& application)
+            {
+                v8::Local<v8::ObjectTemplate> global = v8::ObjectTemplate::New(pIsolate);
+                for (const Global* pGlobal = Globals; pGlobal->name; ++pGlobal)
+                    global->Set(pIsolate, pGlobal->name, v8::FunctionTemplate::New(pIsolate, pGlobal->callback));
+                v8::Local<v8::ObjectTemplate> consoleObject = v8::ObjectTemplate::New(pIsolate);
+                for (const Global* pGlobal = ConsoleMethods; pGlobal->name; ++pGlobal)
+                    consoleObject->Set(pIsolate, pGlobal->name, v8::FunctionTemplate::New(pIsolate, pGlobal->callback));
+                global->Set(pIsolate, "console", consoleObject);
+                v8::Local<v8::ObjectTemplate> fsObject = v8::ObjectTemplate::New(pIsolate);
+                for (const Global* pGlobal = FileMethods; pGlobal->name; ++pGlobal)
+                    fsObject->Set(pIsolate, pGlobal->name, v8::FunctionTemplate::New(pIsolate, pGlobal->callback));
+                global->Set(pIsolate, "fs", fsObject);
+
+                binding::Class<IRenderElement> elementClass(pIsolate, "__Element", newElement, 2);
+                describeElement(elementClass, bFastApi);
+                element = elementClass.get();
+                global->Set(pIsolate, "__Element", element);
+
+                binding::Class<Engine> applicationClass(pIsolate, "__Application");
+                describeApplication(applicationClass);
+                application = applicationClass.get();
+
+                binding::Class<WorkerRecord> workerClass(pIsolate, "Worker", newWorker);
+                describeWorker(workerClass);
+                global->Set(pIsolate, "Worker", workerClass.get());
+                return global;
+            }
+
+            static const intptr_t* getExternalReferences(bool bFastApi)
+            {
+                static binding::References references[2];
+                binding::References& result = references[bFastApi ? 1 : 0];
+                if (!result.empty())
+                    return result.get();
+                for (const Global* pGlobal = Globals; pGlobal->name; ++pGlobal)
+                    result.add(pGlobal->callback);
+                for (const Global* pGlobal = ConsoleMethods; pGlobal->name; ++pGlobal)
+                    result.add(pGlobal->callback);
+                for (const Global* pGlobal = FileMethods; pGlobal->name; ++pGlobal)
+                    result.add(pGlobal->callback);
+                result.add(newElement);
+                describeElement(result, bFastApi);
+                describeApplication(result);
+                result.add(newWorker);
+                describeWorker(result);
+                return result.get();
+            }
+
+            static uint64_t getSnapshotVersion(bool bFastApi)
+            {
+                const char* version = v8::V8::GetVersion();
+                // Bindings added since the snapshot was written would shift
+                // the external references, so their count is part of it.
+                uint64_t nReferences = 0;
+                for (const intptr_t* pReference = getExternalReferences(bFastApi); *pReference; ++pReference)
+                    ++nReferences;
+                return CodeCache::hash(version, strlen(version)) ^ v8::ScriptCompiler::CachedDataVersionTag() ^ (nReferences << 32) ^ ((uint64_t)binding::LAYOUT_VERSION << 56);
+            }
 
+            // Snapshots written by another V8 build or with other flags are
+            // ignored, V8 aborts on blobs it can't deserialize.
+            static bool readSnapshot(const char* path, bool bFastApi, v8::StartupData& snapshot)
+            {
+                FILE* file = path[0] ? fopen(path, "rb") : nullptr;
+                if (file == nullptr)
+                    return false;
+                SnapshotHeader header;
                 fseek(file, 0, SEEK_END);
-                size_t size = ftell(file);
+                const long size = ftell(file) - (long)sizeof(header);
                 rewind(file);
-
-                char* chars = (char*)malloc(size + 1);
-                chars[size] = '\0';
-                for (size_t i = 0; i < size;) 
+                bool bValid = size > 0 && fread(&header, sizeof(header), 1, file) == 1 && header.magic == SNAPSHOT_MAGIC &&
+                              header.flags == (bFastApi ? 1u : 0u) && header.version == getSnapshotVersion(bFastApi);
+                if (bValid)
                 {
-                    i += fread(&chars[i], 1, size - i, file);
-                    if (ferror(file)) 
+                    char* pData = new char[size];
+                    bValid = fread(pData, 1, size, file) == (size_t)size;
+                    snapshot.data = pData;
+                    snapshot.raw_size = (int)size;
+                    if (!bValid || !snapshot.IsValid())
                     {
-                        fclose(file);
-                        return v8::MaybeLocal<v8::String>();
+                        delete[] pData;
+                        snapshot.data = nullptr;
+                        bValid = false;
                     }
                 }
                 fclose(file);
-                v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(m_pIsolate, chars, v8::NewStringType::kNormal, static_cast<int>(size));
-                free(chars);
+                return bValid;
+            }
+
+            // Writes a startup snapshot with the global functions and the
+            // native classes instantiated.
+            static bool createSnapshot(const EngineParameters& params, const char* path)
+            {
+                std::unique_ptr<v8::Platform> pPlatform = initializeV8(params.fastApiCalls);
+                v8::StartupData blob = { nullptr, 0 };
+                {
+                    v8::SnapshotCreator creator(getExternalReferences(params.fastApiCalls));
+                    v8::Isolate* pIsolate = creator.GetIsolate();
+                    {
+                        v8::HandleScope scope(pIsolate);
+                        v8::Local<v8::FunctionTemplate> element, application;
+                        v8::Local<v8::Context> context = v8::Context::New(pIsolate, nullptr, createGlobal(pIsolate, params.fastApiCalls, element, application));
+                        creator.AddData(element);
+                        creator.AddData(application);
+                        creator.SetDefaultContext(context);
+                    }
+                    blob = creator.CreateBlob(v8::SnapshotCreator::FunctionCodeHandling::kKeep);
+                }
+                bool bWritten = false;
+                FILE* file = blob.data ? fopen(path, "wb") : nullptr;
+                if (file)
+                {
+                    const SnapshotHeader header = { SNAPSHOT_MAGIC, params.fastApiCalls ? 1u : 0u, getSnapshotVersion(params.fastApiCalls) };
+                    bWritten = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(blob.data, 1, blob.raw_size, file) == (size_t)blob.raw_size;
+                    fclose(file);
+                }
+                printf(bWritten ? "Snapshot written to %s (%d bytes)\n" : "Unable to write snapshot %s\n", path, blob.raw_size);
+                delete[] blob.data;
+                v8::V8::Dispose();
+                v8::V8::ShutdownPlatform();
+                return bWritten;
+            }
+
+            // Source text backed by a mapped file, owned by V8 until the
+            // string is collected.
+            class MappedSource : public v8::String::ExternalOneByteStringResource
+            {
+            public:
+
+                explicit MappedSource(platform::MappedFile* pFile) : m_pFile(pFile) {}
+                ~MappedSource() override { platform::unmapFile(m_pFile); }
+
+                const char* data() const override { return m_pFile->data; }
+                size_t length() const override { return m_pFile->size; }
+
+            private:
+
+                platform::MappedFile* m_pFile;
+            };
+
+            static bool isAscii(const char* data, size_t size)
+            {
+                size_t i = 0;
+                for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+                {
+                    uint64_t word;
+                    memcpy(&word, data + i, sizeof(word));
+                    if (word & 0x8080808080808080ull)
+                        return false;
+                }
+                for (; i < size; ++i)
+                {
+                    if (data[i] & 0x80)
+                        return false;
+                }
+                return true;
+            }
+
+            // Module sources are mapped instead of read. ASCII sources become
+            // external strings over the mapping, so the text is neither
+            // copied nor held in the JS heap; others are decoded from UTF-8
+            // in a single pass straight from the mapping.
+            v8::MaybeLocal<v8::String> readFile(const wchar_t* name, uint64_t* pHash = nullptr)
+            {
+                platform::MappedFile* pFile = platform::mapFile(name);
+                if (pFile == nullptr || pFile->size > (size_t)v8::String::kMaxLength)
+                {
+                    platform::unmapFile(pFile);
+                    return v8::MaybeLocal<v8::String>();
+                }
+                if (pHash)
+                    *pHash = CodeCache::hash(pFile->data, pFile->size);
+                if (isAscii(pFile->data, pFile->size))
+                    return v8::String::NewExternalOneByte(m_pIsolate, new MappedSource(pFile));
+                v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(m_pIsolate, pFile->data, v8::NewStringType::kNormal, static_cast<int>(pFile->size));
+                platform::unmapFile(pFile);
                 return result;
             }
 
@@ -118,407 +485,1856 @@ namespace flint
                 v8::HandleScope handle_scope(m_pIsolate);
                 v8::String::Utf8Value exception(m_pIsolate, try_catch->Exception());
                 v8::Local<v8::Message> message = try_catch->Message();
+                // Written as one message so it stays in order with the
+                // script's output.
+                std::string text;
                 if (message.IsEmpty())
-                    printf("%s\n", *exception);
+                    text = *exception ? *exception : "";
                 else
                 {
                     v8::String::Utf8Value filename(m_pIsolate, message->GetScriptOrigin().ResourceName());
                     v8::Local<v8::Context> context =  m_context.Get(m_pIsolate);
                     const int linenum = message->GetLineNumber(context).FromJust();
-                    printf("%s:%i: %s\n", *filename, linenum, *exception);
+                    text = std::string(*filename ? *filename : "") + ":" + std::to_string(linenum) + ": " + (*exception ? *exception : "") + "\n";
                     v8::String::Utf8Value sourceline(m_pIsolate, message->GetSourceLine(context).ToLocalChecked());
-                    printf("%s\n", *sourceline);
+                    text += *sourceline ? *sourceline : "";
+                    text += '\n';
                     const  int start = message->GetStartColumn(context).FromJust();
-                    for (int i = 0; i < start; i++)
-                        printf(" ");
                     const int end = message->GetEndColumn(context).FromJust();
-                    for (int i = start; i < end; i++)
-                        printf("^");
-                    printf("\n");
+                    text.append(start, ' ');
+                    text.append(std::max(end - start, 0), '^');
                     v8::Local<v8::Value> stack_trace_string;
                     if (try_catch->StackTrace(context).ToLocal(&stack_trace_string) && stack_trace_string->IsString() && stack_trace_string.As<v8::String>()->Length() > 0)
                     {
                         v8::String::Utf8Value stack_trace(m_pIsolate, stack_trace_string);
-                        printf("%s\n", *stack_trace);
+                        text += '\n';
+                        text += *stack_trace;
+                    }
+                }
+                console::write(console::Level::ERR, text.data(), text.size());
+            }
+
+            // Modules are registered by canonical path, so a file is compiled
+            // once however it is imported. The built in flint module and
+            // inline modules have no path.
+            struct ModuleEntry
+            {
+                v8::Global<v8::Module> module;
+                std::wstring path;
+                uint64_t sourceHash;
+                bool bStoreCache;
+            };
+
+            // A module read and parsed on a worker thread for import().
+            struct StreamedModule
+            {
+                std::wstring path;
+                std::unique_ptr<v8::ScriptCompiler::StreamedSource> pSource;
+                std::unique_ptr<v8::ScriptCompiler::ScriptStreamingTask> pTask;
+                platform::MappedFile* pFile;
+                uint64_t sourceHash;
+                std::atomic<bool> bDone;
+            };
+
+            // Hands the mapped file to V8 in one chunk, called on the worker.
+            class FileStream : public v8::ScriptCompiler::ExternalSourceStream
+            {
+            public:
+
+                explicit FileStream(StreamedModule& module) : m_module(module), m_bRead(false) {}
+
+                size_t GetMoreData(const uint8_t** src) override
+                {
+                    if (m_bRead)
+                        return 0;
+                    m_bRead = true;
+                    m_module.pFile = platform::mapFile(m_module.path.c_str());
+                    if (m_module.pFile == nullptr || m_module.pFile->size == 0)
+                        return 0;
+                    m_module.sourceHash = CodeCache::hash(m_module.pFile->data, m_module.pFile->size);
+                    // V8 takes ownership of the chunk.
+                    uint8_t* pChunk = new uint8_t[m_module.pFile->size];
+                    memcpy(pChunk, m_module.pFile->data, m_module.pFile->size);
+                    *src = pChunk;
+                    return m_module.pFile->size;
+                }
+
+            private:
+
+                StreamedModule& m_module;
+                bool m_bRead;
+            };
+
+            struct PendingImport
+            {
+                v8::Global<v8::Promise::Resolver> resolver;
+                std::wstring key;
+            };
+
+            enum class ImportState
+            {
+                PENDING,
+                READY,
+                FAILED
+            };
+
+            static std::wstring getModuleKey(const std::wstring& path)
+            {
+                std::wstring key(path);
+                for (size_t i = 0; i < key.size(); ++i)
+                    key[i] = towlower(key[i]);
+                return key;
+            }
+
+            std::wstring getDirectory(const std::wstring& path) const
+            {
+                const size_t separator = path.find_last_of(L"\\/");
+                return (separator == std::wstring::npos) ? m_baseDirectory : path.substr(0, separator);
+            }
+
+            std::wstring resolveSpecifier(v8::Local<v8::String> specifier, const std::wstring& directory) const
+            {
+                v8::String::Value value(m_pIsolate, specifier);
+                const std::wstring name(reinterpret_cast<const wchar_t*>(*value), value.length());
+                if (_wcsicmp(name.c_str(), L"flint") == 0)
+                    return L"flint";
+                return platform::resolvePath(directory.c_str(), name.c_str());
+            }
+
+            ModuleEntry& addModule(const std::wstring& key, const std::wstring& path, v8::Local<v8::Module> module, uint64_t sourceHash, bool bStoreCache)
+            {
+                removeModule(key);
+                ModuleEntry& entry = m_modules[key];
+                entry.module.Reset(m_pIsolate, module);
+                entry.path = path;
+                entry.sourceHash = sourceHash;
+                entry.bStoreCache = bStoreCache;
+                m_moduleIds.emplace(module->GetIdentityHash(), &entry);
+                return entry;
+            }
+
+            void removeModule(const std::wstring& key)
+            {
+                auto itr = m_modules.find(key);
+                if (itr == m_modules.end())
+                    return;
+                auto range = m_moduleIds.equal_range(itr->second.module.Get(m_pIsolate)->GetIdentityHash());
+                for (auto id = range.first; id != range.second; ++id)
+                {
+                    if (id->second == &itr->second)
+                    {
+                        m_moduleIds.erase(id);
+                        break;
                     }
                 }
+                m_modules.erase(itr);
+            }
+
+            ModuleEntry* findModule(v8::Local<v8::Module> module)
+            {
+                auto range = m_moduleIds.equal_range(module->GetIdentityHash());
+                for (auto itr = range.first; itr != range.second; ++itr)
+                {
+                    if (itr->second->module == module)
+                        return itr->second;
+                }
+                return nullptr;
+            }
+
+            std::wstring getModuleDirectory(v8::Local<v8::Module> module)
+            {
+                ModuleEntry* pEntry = findModule(module);
+                return (pEntry && !pEntry->path.empty()) ? getDirectory(pEntry->path) : m_baseDirectory;
+            }
+
+            // Compiles and registers a module, consuming and scheduling code
+            // cache entries for modules read from disk.
+            v8::MaybeLocal<v8::Module> compileModule(const std::wstring& key, const std::wstring& path, v8::Local<v8::String> source, uint64_t sourceHash)
+            {
+                std::unique_ptr<char> filename(toUTF8(path.empty() ? key.c_str() : path.c_str()));
+                v8::Local<v8::String> name = v8::String::NewFromUtf8(m_pIsolate, filename.get()).ToLocalChecked();
+                v8::ScriptOrigin origin(m_pIsolate, name, 0, 0, false, -1, v8::Local<v8::Value>(), false, false, true);
+                // Only modules read from disk are cached, a rejected
+                // entry is rebuilt once the module has been evaluated.
+                const bool bCacheable = m_bCodeCache && !path.empty();
+                v8::ScriptCompiler::CachedData* pCached = bCacheable ? m_codeCache.load(path, sourceHash) : nullptr;
+                v8::ScriptCompiler::Source compiler(source, origin, pCached);
+                CodeCache::Stats& cacheStats = m_codeCache.getStats();
+                v8::Local<v8::Module> module;
+                bool bCompiled;
+                {
+                    FLINT_TRACE_SCOPE("CompileModule");
+                    Stopwatch watch;
+                    bCompiled = v8::ScriptCompiler::CompileModule(m_pIsolate, &compiler, pCached ? v8::ScriptCompiler::kConsumeCodeCache : v8::ScriptCompiler::kNoCompileOptions).ToLocal(&module);
+                    cacheStats.compileTime += watch.lap();
+                }
+                bool bStoreCache = bCacheable;
+                if (pCached && compiler.GetCachedData()->rejected)
+                    ++cacheStats.rejected;
+                else if (pCached)
+                {
+                    ++cacheStats.hits;
+                    bStoreCache = false;
+                }
+                if (bStoreCache)
+                    ++cacheStats.misses;
+                if (!bCompiled)
+                    return v8::MaybeLocal<v8::Module>();
+                addModule(key, path, module, sourceHash, bStoreCache);
+                return module;
+            }
+
+            // Returns the module at a resolved path, reading and compiling it
+            // on the calling thread when it isn't registered yet.
+            v8::MaybeLocal<v8::Module> fetchModule(const std::wstring& path)
+            {
+                const std::wstring key = getModuleKey(path);
+                auto itr = m_modules.find(key);
+                if (itr != m_modules.end())
+                    return itr->second.module.Get(m_pIsolate);
+                v8::Local<v8::String> source;
+                if (key == L"flint")
+                {
+                    v8::String::NewFromUtf8(m_pIsolate, FlintModule).ToLocal(&source);
+                    return compileModule(key, std::wstring(), source, 0);
+                }
+                uint64_t sourceHash = 0;
+                if (!readFile(path.c_str(), &sourceHash).ToLocal(&source))
+                {
+                    std::unique_ptr<char> name(toUTF8(path.c_str()));
+                    const std::string error = std::string("Cannot find module ") + name.get();
+                    m_pIsolate->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(m_pIsolate, error.c_str(), v8::NewStringType::kNormal, (int)error.size()).ToLocalChecked()));
+                    return v8::MaybeLocal<v8::Module>();
+                }
+                return compileModule(key, path, source, sourceHash);
             }
 
             static v8::MaybeLocal<v8::Module> resolveModules(v8::Local<v8::Context> context, v8::Local<v8::String> specifier, v8::Local<v8::FixedArray> import_assertions, v8::Local<v8::Module> referrer)
             {
-                v8::Isolate* isolate = context->GetIsolate();
-                std::string path(specifier->Length(), 0);
-                specifier->WriteOneByte(isolate, (uint8_t*)&path[0]);
-                Environment* m_pEnvironment = reinterpret_cast<Environment*>(isolate->GetData(0));
-                auto itr = m_pEnvironment->Modules.find(path);
-                if (itr != m_pEnvironment->Modules.end())
+                Environment* m_pEnvironment = reinterpret_cast<Environment*>(context->GetIsolate()->GetData(0));
+                return m_pEnvironment->fetchModule(m_pEnvironment->resolveSpecifier(specifier, m_pEnvironment->getModuleDirectory(referrer)));
+            }
+
+            // Instantiates and evaluates a module graph. Exceptions are left
+            // in the caller's TryCatch.
+            bool runModule(v8::Local<v8::Module> module)
+            {
+                if (module->GetStatus() == v8::Module::kEvaluated)
+                    return true;
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                bool bEvaluated = false;
+                v8::Local<v8::Value> result;
+                if (module->InstantiateModule(context, resolveModules).IsJust() && module->Evaluate(context).ToLocal(&result))
                 {
-                    if (itr->second.Get(isolate)->GetStatus() == v8::Module::Status::kEvaluated)
-                        return v8::MaybeLocal<v8::Module>(itr->second.Get(isolate));
+                    v8::Local<v8::Promise> promise = result.As<v8::Promise>();
+                    if (promise->State() == v8::Promise::kRejected)
+                        m_pIsolate->ThrowException(promise->Result());
                     else
+                        bEvaluated = true;
+                }
+                // Code is cached once evaluated so lazily compiled functions
+                // are included. Failed modules are dropped to be reloaded.
+                for (auto itr = m_modules.begin(); itr != m_modules.end();)
+                {
+                    ModuleEntry& entry = itr->second;
+                    const v8::Module::Status status = entry.module.Get(m_pIsolate)->GetStatus();
+                    if (status == v8::Module::kErrored)
+                    {
+                        const std::wstring key = itr->first;
+                        ++itr;
+                        removeModule(key);
+                        continue;
+                    }
+                    if (entry.bStoreCache && status == v8::Module::kEvaluated)
                     {
-                        const std::string error = "Circular dependancy detected while loading " + path;
-                        isolate->ThrowException(v8::String::NewFromUtf8(isolate, error.c_str(), v8::NewStringType::kNormal, (int)error.size()).ToLocalChecked());
-                        return v8::MaybeLocal<v8::Module>();
+                        m_codeCache.store(entry.path, entry.sourceHash, entry.module.Get(m_pIsolate));
+                        entry.bStoreCache = false;
                     }
+                    ++itr;
+                }
+                return bEvaluated;
+            }
+
+            void execute(const char* code)
+            {
+                v8::Isolate::Scope isolate_scope(m_pIsolate);
+                v8::HandleScope handle_scope(m_pIsolate);
+                v8::Local<v8::Context> context = v8::Context::New(m_pIsolate);
+                v8::Context::Scope context_scope(context);
+                v8::Local<v8::String> source = v8::String::NewFromUtf8(m_pIsolate, code, v8::NewStringType::kNormal).ToLocalChecked();
+                v8::Local<v8::Script> script = v8::Script::Compile(context, source).ToLocalChecked();
+                // Run the script to get the result.
+                v8::Local<v8::Value> result = script->Run(context).ToLocalChecked();
+                if (result.IsEmpty())
+                    int k = 0;
+            }
+
+            v8::MaybeLocal<v8::Module> load(const wchar_t* moduleName, const char* code = 0)
+            {
+                v8::EscapableHandleScope handle_scope(m_pIsolate);
+                v8::TryCatch try_catch(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                v8::Local<v8::Module> module;
+                bool bCompiled;
+                if (code)
+                {
+                    v8::Local<v8::String> source;
+                    bCompiled = v8::String::NewFromUtf8(m_pIsolate, code).ToLocal(&source) && compileModule(std::wstring(), std::wstring(), source, 0).ToLocal(&module);
                 }
                 else
+                    bCompiled = fetchModule(platform::resolvePath(m_baseDirectory.c_str(), moduleName)).ToLocal(&module);
+                if (!bCompiled || !runModule(module))
+                {
+                    reportException(&try_catch);
+                    return v8::MaybeLocal<v8::Module>();
+                }
+                if (code)
+                {
+                    v8::Local<v8::Object> ns = module->GetModuleNamespace()->ToObject(context).ToLocalChecked();
+                    v8::Local<v8::Value> result = ns->Get(context, binding::getString(m_pIsolate, binding::Name::RES)).ToLocalChecked();
+                    if (result->IsObject())
+                        setApplication(result.As<v8::Object>());
+                }
+                return handle_scope.Escape(module);
+            }
+
+            // The entry points called from native code are looked up once
+            // here instead of on every call, replacing the application drops
+            // the old ones. An application without update() is rejected.
+            bool setApplication(v8::Local<v8::Object> application)
+            {
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                v8::Local<v8::Value> update, load, fireEvent;
+                if (!application->Get(context, binding::getString(m_pIsolate, binding::Name::UPDATE)).ToLocal(&update) || !update->IsFunction())
+                    return false;
+                m_application.Reset(m_pIsolate, application);
+                m_update.Reset(m_pIsolate, update.As<v8::Function>());
+                m_load.Reset();
+                m_fireEvent.Reset();
+                if (application->Get(context, binding::getString(m_pIsolate, binding::Name::LOAD)).ToLocal(&load) && load->IsFunction())
+                    m_load.Reset(m_pIsolate, load.As<v8::Function>());
+                if (application->Get(context, binding::getString(m_pIsolate, binding::Name::FIRE_EVENT)).ToLocal(&fireEvent) && fireEvent->IsFunction())
+                    m_fireEvent.Reset(m_pIsolate, fireEvent.As<v8::Function>());
+                return true;
+            }
+
+            // import() resolves relative to the importing script. The module
+            // and its static dependencies are read and parsed on worker
+            // threads, the promise settles in processImports once the whole
+            // graph is compiled.
+            static v8::MaybeLocal<v8::Promise> importModule(v8::Local<v8::Context> context, v8::Local<v8::ScriptOrModule> referrer, v8::Local<v8::String> specifier, v8::Local<v8::FixedArray> import_assertions)
+            {
+                v8::Isolate* pIsolate = context->GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*>(pIsolate->GetData(0));
+                v8::Local<v8::Promise::Resolver> resolver;
+                if (!v8::Promise::Resolver::New(context).ToLocal(&resolver))
+                    return v8::MaybeLocal<v8::Promise>();
+                std::wstring directory = m_pEnvironment->m_baseDirectory;
+                v8::Local<v8::Value> name = referrer->GetResourceName();
+                if (name->IsString() && name.As<v8::String>()->Length() > 0)
+                {
+                    v8::String::Value value(pIsolate, name);
+                    directory = m_pEnvironment->getDirectory(std::wstring(reinterpret_cast<const wchar_t*>(*value), value.length()));
+                }
+                const std::wstring path = m_pEnvironment->resolveSpecifier(specifier, directory);
+                std::unique_ptr<PendingImport> pImport(new PendingImport());
+                pImport->resolver.Reset(pIsolate, resolver);
+                pImport->key = getModuleKey(path);
+                m_pEnvironment->m_vecImports.push_back(std::move(pImport));
+                m_pEnvironment->requestModule(path);
+                return resolver->GetPromise();
+            }
+
+            void requestModule(const std::wstring& path)
+            {
+                const std::wstring key = getModuleKey(path);
+                if (m_modules.count(key) || m_streaming.count(key))
+                    return;
+                if (key == L"flint")
+                {
+                    v8::TryCatch try_catch(m_pIsolate);
+                    fetchModule(path);
+                    return;
+                }
+                StreamedModule* pModule = new StreamedModule();
+                pModule->path = path;
+                pModule->pFile = nullptr;
+                pModule->sourceHash = 0;
+                pModule->bDone = false;
+                pModule->pSource.reset(new v8::ScriptCompiler::StreamedSource(std::unique_ptr<v8::ScriptCompiler::ExternalSourceStream>(new FileStream(*pModule)), v8::ScriptCompiler::StreamedSource::UTF8));
+                pModule->pTask.reset(v8::ScriptCompiler::StartStreaming(m_pIsolate, pModule->pSource.get(), v8::ScriptType::kModule));
+                m_streaming[key].reset(pModule);
+                // Not on the compute pool: tasks queued from the main thread
+                // would be picked up by its waits for parallel layout and
+                // rendering, in the middle of a frame.
+                ThreadPool::GetIO().run(m_imports, [pModule]()
+                {
+                    FLINT_TRACE_SCOPE("Environment::streamModule");
+                    pModule->pTask->Run();
+                    pModule->bDone.store(true, std::memory_order_release);
+                });
+            }
+
+            // Finalizes a module parsed on a worker and requests its imports.
+            void finishModule(const std::wstring& key, StreamedModule& streamed)
+            {
+                v8::HandleScope scope(m_pIsolate);
+                v8::TryCatch try_catch(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                platform::MappedFile* pFile = streamed.pFile;
+                streamed.pFile = nullptr;
+                if (m_modules.count(key))
+                {
+                    // Imported statically in the meantime.
+                    platform::unmapFile(pFile);
+                    return;
+                }
+                v8::Local<v8::String> source;
+                if (pFile && isAscii(pFile->data, pFile->size) && pFile->size <= (size_t)v8::String::kMaxLength)
+                    v8::String::NewExternalOneByte(m_pIsolate, new MappedSource(pFile)).ToLocal(&source);
+                else if (pFile)
+                {
+                    v8::String::NewFromUtf8(m_pIsolate, pFile->data, v8::NewStringType::kNormal, (int)pFile->size).ToLocal(&source);
+                    platform::unmapFile(pFile);
+                }
+                v8::Local<v8::Module> module;
+                if (source.IsEmpty())
+                {
+                    std::unique_ptr<char> name(toUTF8(streamed.path.c_str()));
+                    const std::string error = std::string("Cannot find module ") + name.get();
+                    m_importErrors[key].Reset(m_pIsolate, v8::Exception::Error(v8::String::NewFromUtf8(m_pIsolate, error.c_str(), v8::NewStringType::kNormal, (int)error.size()).ToLocalChecked()));
+                    return;
+                }
+                std::unique_ptr<char> filename(toUTF8(streamed.path.c_str()));
+                v8::ScriptOrigin origin(m_pIsolate, v8::String::NewFromUtf8(m_pIsolate, filename.get()).ToLocalChecked(), 0, 0, false, -1, v8::Local<v8::Value>(), false, false, true);
+                if (!v8::ScriptCompiler::CompileModule(context, streamed.pSource.get(), source, origin).ToLocal(&module))
+                {
+                    m_importErrors[key].Reset(m_pIsolate, try_catch.Exception());
+                    return;
+                }
+                addModule(key, streamed.path, module, streamed.sourceHash, false);
+                const std::wstring directory = getDirectory(streamed.path);
+                v8::Local<v8::FixedArray> requests = module->GetModuleRequests();
+                for (int i = 0; i < requests->Length(); ++i)
+                    requestModule(resolveSpecifier(requests->Get(context, i).As<v8::ModuleRequest>()->GetSpecifier(), directory));
+            }
+
+            ImportState getImportState(const std::wstring& root, v8::Local<v8::Value>& error)
+            {
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                std::vector<std::wstring> vecStack(1, root);
+                std::set<std::wstring> visited;
+                bool bPending = false;
+                while (!vecStack.empty())
                 {
-                    std::unique_ptr<wchar_t> wpath(toWideChar(path.c_str()));
-                    return m_pEnvironment->load(wpath.get());
+                    const std::wstring key = vecStack.back();
+                    vecStack.pop_back();
+                    if (!visited.insert(key).second)
+                        continue;
+                    if (m_streaming.count(key))
+                    {
+                        bPending = true;
+                        continue;
+                    }
+                    auto failed = m_importErrors.find(key);
+                    if (failed != m_importErrors.end())
+                    {
+                        error = failed->second.Get(m_pIsolate);
+                        return ImportState::FAILED;
+                    }
+                    auto itr = m_modules.find(key);
+                    if (itr == m_modules.end())
+                    {
+                        error = v8::Exception::Error(v8::String::NewFromUtf8Literal(m_pIsolate, "Module failed to load"));
+                        return ImportState::FAILED;
+                    }
+                    v8::Local<v8::Module> module = itr->second.module.Get(m_pIsolate);
+                    if (module->GetStatus() == v8::Module::kEvaluated)
+                        continue;
+                    const std::wstring directory = getDirectory(itr->second.path);
+                    v8::Local<v8::FixedArray> requests = module->GetModuleRequests();
+                    for (int i = 0; i < requests->Length(); ++i)
+                        vecStack.push_back(getModuleKey(resolveSpecifier(requests->Get(context, i).As<v8::ModuleRequest>()->GetSpecifier(), directory)));
                 }
+                return bPending ? ImportState::PENDING : ImportState::READY;
+            }
+
+            // Where the collector runs, pauses are counted per phase.
+            enum class GCPhase
+            {
+                OTHER,
+                FRAME,
+                IDLE
             };
 
-            void execute(const char* code)
+            // Idle steps shorter than this are not worth the call, longer
+            // ones would delay input noticeably.
+            static constexpr double MIN_IDLE_BUDGET = 1.0;
+            static constexpr double MAX_IDLE_BUDGET = 10.0;
+
+            static void onGCPrologue(v8::Isolate*, v8::GCType, v8::GCCallbackFlags, void* data)
+            {
+                Environment* pEnvironment = reinterpret_cast<Environment*>(data);
+                pEnvironment->m_gcStart = pEnvironment->m_pPlatform->MonotonicallyIncreasingTime();
+            }
+
+            static void onGCEpilogue(v8::Isolate*, v8::GCType, v8::GCCallbackFlags, void* data)
+            {
+                Environment* pEnvironment = reinterpret_cast<Environment*>(data);
+                const float time = (float)((pEnvironment->m_pPlatform->MonotonicallyIncreasingTime() - pEnvironment->m_gcStart) * 1000.0);
+                GCStats& stats = pEnvironment->m_gcStats;
+                switch (pEnvironment->m_gcPhase)
+                {
+                case GCPhase::FRAME:
+                    ++stats.frame;
+                    stats.frameTime += time;
+                    break;
+                case GCPhase::IDLE:
+                    ++stats.idle;
+                    stats.idleTime += time;
+                    return;
+                default:
+                    ++stats.other;
+                    stats.otherTime += time;
+                    break;
+                }
+                // The heap changed outside of idle time, there may be idle
+                // work again.
+                pEnvironment->m_bIdleDone = false;
+                pEnvironment->m_bTrimmed = false;
+            }
+
+            // Hands budget milliseconds to V8 for incremental marking and
+            // collection, nothing when that is less than MIN_IDLE_BUDGET so
+            // a frame that is due or late is not held up. Before a sleep
+            // until input the memory pools are trimmed and V8 is told to
+            // shrink its heap as well. Returns true while V8 has more idle
+            // work.
+            bool idle(double budget, bool bUntilInput)
+            {
+                if (bUntilInput)
+                {
+                    if (!m_bTrimmed)
+                    {
+                        FLINT_TRACE_SCOPE("Environment::trim");
+                        memory::trim();
+                        m_pIsolate->MemoryPressureNotification(v8::MemoryPressureLevel::kModerate);
+                        m_bTrimmed = true;
+                    }
+                    budget = MAX_IDLE_BUDGET;
+                }
+                if (m_bIdleDone || budget < MIN_IDLE_BUDGET)
+                    return false;
+                FLINT_TRACE_SCOPE("Environment::idle");
+                m_gcPhase = GCPhase::IDLE;
+                m_bIdleDone = m_pIsolate->IdleNotificationDeadline(m_pPlatform->MonotonicallyIncreasingTime() + std::min(budget, MAX_IDLE_BUDGET) / 1000.0);
+                m_gcPhase = GCPhase::OTHER;
+                return !m_bIdleDone;
+            }
+
+            bool isImporting() const
+            {
+                return !m_vecImports.empty() || !m_streaming.empty();
+            }
+
+            // Called every frame, settles the imports whose modules are ready.
+            void processImports()
+            {
+                if (m_vecImports.empty() && m_streaming.empty())
+                    return;
+                FLINT_TRACE_SCOPE("Environment::processImports");
+                v8::HandleScope scope(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                std::vector<std::wstring> vecDone;
+                for (auto itr = m_streaming.begin(); itr != m_streaming.end(); ++itr)
+                {
+                    if (itr->second->bDone.load(std::memory_order_acquire))
+                        vecDone.push_back(itr->first);
+                }
+                for (size_t i = 0; i < vecDone.size(); ++i)
+                {
+                    std::unique_ptr<StreamedModule> pModule(std::move(m_streaming[vecDone[i]]));
+                    m_streaming.erase(vecDone[i]);
+                    finishModule(vecDone[i], *pModule);
+                }
+                for (size_t i = 0; i < m_vecImports.size();)
+                {
+                    v8::Local<v8::Value> error;
+                    const ImportState state = getImportState(m_vecImports[i]->key, error);
+                    if (state == ImportState::PENDING)
+                    {
+                        ++i;
+                        continue;
+                    }
+                    v8::Local<v8::Promise::Resolver> resolver = m_vecImports[i]->resolver.Get(m_pIsolate);
+                    if (state == ImportState::FAILED)
+                        resolver->Reject(context, error).Check();
+                    else
+                    {
+                        v8::TryCatch try_catch(m_pIsolate);
+                        v8::Local<v8::Module> module = m_modules[m_vecImports[i]->key].module.Get(m_pIsolate);
+                        if (runModule(module))
+                            resolver->Resolve(context, module->GetModuleNamespace()).Check();
+                        else
+                            resolver->Reject(context, try_catch.HasCaught() ? try_catch.Exception() : v8::Undefined(m_pIsolate).As<v8::Value>()).Check();
+                    }
+                    m_vecImports.erase(m_vecImports.begin() + i);
+                }
+                if (m_vecImports.empty())
+                    m_importErrors.clear();
+            }
+
+            static void getSize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Object>& params, Size& size)
+            {
+                v8::Local<v8::Value> value;
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::SIZE)).ToLocal(&value))
+                {
+                    int32_t width = size.width, height = size.height;
+                    if (value->IsArray())
+                    {
+                        v8::Local<v8::Array> szArray = v8::Handle<v8::Array>::Cast(value);
+                        if (szArray->Length() > 1)
+                        {
+                            width = szArray->Get(context, 0).ToLocalChecked()->Int32Value(context).ToChecked();
+                            height = szArray->Get(context, 1).ToLocalChecked()->Int32Value(context).ToChecked();
+                        }
+                    }
+                    else if (value->IsObject())
+                    {
+                        v8::Local<v8::Object> szObject = v8::Handle<v8::Object>::Cast(value);
+                        auto w = binding::getString(pIsolate, binding::Name::WIDTH);
+                        auto h = binding::getString(pIsolate, binding::Name::HEIGHT);
+                        if (szObject->Has(context, w).IsJust() && szObject->Has(context, h).IsJust())
+                        {
+                            width = szObject->Get(context, w).ToLocalChecked()->Int32Value(context).ToChecked();
+                            height = szObject->Get(context, h).ToLocalChecked()->Int32Value(context).ToChecked();
+                        }
+                    }
+                    size.width = (Size::Type)std::max<int32_t>(width, 0);
+                    size.height = (Size::Type)std::max<int32_t>(height, 0);
+                }
+            }
+
+            static void getPosition(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Object>& params, Position& position)
+            {
+                v8::Local<v8::Value> value;
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::POSITION)).ToLocal(&value))
+                {
+                    if (value->IsArray())
+                    {
+                        v8::Local<v8::Array> szArray = v8::Handle<v8::Array>::Cast(value);
+                        if (szArray->Length() > 1)
+                        {
+                            position.x = (Position::Type)szArray->Get(context, 0).ToLocalChecked()->Int32Value(context).ToChecked();
+                            position.y = (Position::Type)szArray->Get(context, 1).ToLocalChecked()->Int32Value(context).ToChecked();
+                        }
+                    }
+                    else if (value->IsObject())
+                    {
+                        v8::Local<v8::Object> szPosition = v8::Handle<v8::Object>::Cast(value);
+                        auto x = binding::getString(pIsolate, binding::Name::X);
+                        auto y = binding::getString(pIsolate, binding::Name::Y);
+                        if (szPosition->Has(context, x).IsJust() && szPosition->Has(context, y).IsJust())
+                        {
+                            position.x = (Position::Type)szPosition->Get(context, x).ToLocalChecked()->Int32Value(context).ToChecked();
+                            position.y = (Position::Type)szPosition->Get(context, y).ToLocalChecked()->Int32Value(context).ToChecked();
+                        }
+                    }
+                }
+            }
+
+            static int getEnum(v8::Isolate* pIsolate, v8::Local<v8::Value> value, const char* const* names, int count, int defaultValue)
+            {
+                v8::String::Utf8Value str(pIsolate, value);
+                if (*str)
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        if (strcmp(*str, names[i]) == 0)
+                            return i;
+                    }
+                }
+                return defaultValue;
+            }
+
+            static void getFlex(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Object>& params, IRenderElement* pElement)
+            {
+                static const char* const Directions[] = { "none", "row", "column", "row-reverse", "column-reverse" };
+                static const char* const Justify[] = { "start", "end", "center", "space-between", "space-around", "space-evenly" };
+                static const char* const Align[] = { "auto", "start", "end", "center", "stretch" };
+                v8::Local<v8::Value> value;
+                bool bChanged = false;
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::FLEX)).ToLocal(&value) && value->IsObject())
+                {
+                    FlexStyle& style = pElement->getFlex();
+                    v8::Local<v8::Object> flex = v8::Handle<v8::Object>::Cast(value);
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::DIRECTION)).ToLocal(&value))
+                        style.direction = (FlexStyle::Direction)getEnum(pIsolate, value, Directions, 5, (int)FlexStyle::Direction::ROW);
+                    else if (!style.isContainer())
+                        style.direction = FlexStyle::Direction::ROW;
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::WRAP)).ToLocal(&value))
+                        style.bWrap = value->BooleanValue(pIsolate);
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::GAP)).ToLocal(&value))
+                        style.gap = (uint16_t)std::max<int32_t>(value->Int32Value(context).FromMaybe(0), 0);
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::JUSTIFY)).ToLocal(&value))
+                        style.justify = (FlexStyle::Justify)getEnum(pIsolate, value, Justify, 6, (int)FlexStyle::Justify::START);
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::ALIGN)).ToLocal(&value))
+                        style.alignItems = (FlexStyle::Align)getEnum(pIsolate, value, Align, 5, (int)FlexStyle::Align::STRETCH);
+                    if (flex->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::PADDING)).ToLocal(&value))
+                    {
+                        if (value->IsArray())
+                        {
+                            v8::Local<v8::Array> padding = v8::Handle<v8::Array>::Cast(value);
+                            for (uint32_t i = 0; i < 4 && i < padding->Length(); ++i)
+                                style.padding[i] = (uint16_t)std::max<int32_t>(padding->Get(context, i).ToLocalChecked()->Int32Value(context).FromMaybe(0), 0);
+                        }
+                        else
+                        {
+                            const uint16_t padding = (uint16_t)std::max<int32_t>(value->Int32Value(context).FromMaybe(0), 0);
+                            style.padding[0] = style.padding[1] = style.padding[2] = style.padding[3] = padding;
+                        }
+                    }
+                    bChanged = true;
+                }
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::GROW)).ToLocal(&value))
+                {
+                    pElement->getFlex().grow = std::max<float>((float)value->NumberValue(context).FromMaybe(0), 0);
+                    bChanged = true;
+                }
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::SHRINK)).ToLocal(&value))
+                {
+                    pElement->getFlex().shrink = std::max<float>((float)value->NumberValue(context).FromMaybe(1), 0);
+                    bChanged = true;
+                }
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::BASIS)).ToLocal(&value))
+                {
+                    pElement->getFlex().basis = value->IsNumber() ? value->Int32Value(context).FromMaybe(-1) : -1;
+                    bChanged = true;
+                }
+                if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::ALIGN_SELF)).ToLocal(&value))
+                {
+                    pElement->getFlex().alignSelf = (FlexStyle::Align)getEnum(pIsolate, value, Align, 5, (int)FlexStyle::Align::AUTO);
+                    bChanged = true;
+                }
+                if (bChanged)
+                    pElement->invalidateFlex();
+            }
+
+            static void __f_init(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                Engine& engine = m_pEnvironment->m_engine;
+                v8::HandleScope scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                EngineParameters& engineParams = engine.getParameters();
+                if (args.Length() > 0 && args[0]->IsObject())
+                {
+                    v8::Local<v8::Object> params = args[0]->ToObject(context).ToLocalChecked();
+                    getSize(pIsolate, context, params, engineParams.size);
+                    v8::Local<v8::Value> value;
+                    if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::TITLE)).ToLocal(&value))
+                    {
+                        v8::String::Utf8Value val(pIsolate, value->ToString(context).ToLocalChecked());
+                        std::unique_ptr<wchar_t> str(toWideChar(*val));
+                        engineParams.title = str.get();
+                    }
+                    if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::STATE)).ToLocal(&value))
+                    {
+                        const uint32_t state = value->Int32Value(context).FromJust();
+                        if (state <= (int)EngineState::MAXIMIZED)
+                            engineParams.state = (EngineState)state;
+                    }
+                }
+                v8::Local<v8::Array> result = v8::Array::New(pIsolate, 4);
+                result->Set(context, 0, v8::Integer::NewFromUnsigned(pIsolate, engineParams.size.width));
+                result->Set(context, 1, v8::Integer::NewFromUnsigned(pIsolate, engineParams.size.height));
+                result->Set(context, 2, v8::String::NewFromTwoByte(pIsolate, (const uint16_t*)engineParams.title.c_str()).ToLocalChecked());
+                result->Set(context, 3, v8::Integer::NewFromUnsigned(pIsolate, (uint32_t)engineParams.state));
+                args.GetReturnValue().Set(result);
+            }
+
+            // 0 returns whether a capture is running, 1 begins a named event
+            // and 2 ends the innermost one.
+            static void __f_trace(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                v8::HandleScope scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                switch (args[0]->Int32Value(context).FromJust())
+                {
+                case 0:
+                    args.GetReturnValue().Set(trace::isEnabled());
+                    break;
+                case 1:
+                    if (trace::isEnabled())
+                    {
+                        v8::String::Utf8Value name(pIsolate, args[1]);
+                        trace::begin(trace::intern((*name && **name) ? *name : "(anonymous)"));
+                    }
+                    break;
+                case 2:
+                    trace::end();
+                    break;
+                }
+            }
+
+            // Creates the native element of an Element, props may set the
+            // initial size, position, background color and flex properties.
+            static void newElement(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                if (!args.IsConstructCall())
+                {
+                    binding::throwError(pIsolate, "__Element must be called with new");
+                    return;
+                }
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                v8::HandleScope scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                IRenderElement* pElement = new IRenderElement(*m_pEnvironment->m_pRenderer);
+                const uint32_t id = m_pEnvironment->m_commands.add(pElement);
+                binding::wrap(args.This(), pElement);
+                args.This()->SetInternalField(1, v8::Integer::NewFromUnsigned(pIsolate, id));
+                m_pEnvironment->addElement(args.This(), pElement, id);
+                if (args[0]->IsObject())
+                {
+                    v8::Local<v8::Object> params = args[0]->ToObject(context).ToLocalChecked();
+                    Size size = pElement->getSize();
+                    getSize(pIsolate, context, params, size);
+                    Position position = pElement->getPosition();
+                    getPosition(pIsolate, context, params, position);
+                    v8::Local<v8::Value> color;
+                    pElement->setPosition(position);
+                    pElement->setSize(size);
+                    if (params->GetRealNamedProperty(context, binding::getString(pIsolate, binding::Name::BACKGROUND_COLOR)).ToLocal(&color))
+                        pElement->setBackgroundColor(Color(color->Uint32Value(context).ToChecked()));
+                    getFlex(pIsolate, context, params, pElement);
+                }
+            }
+
+            // Element objects keep the native pointer as an aligned pointer
+            // rather than a v8::External so fast API calls can read it
+            // straight off the receiver. Released elements hold null.
+            // Recorded commands are applied first, they may target the
+            // element and its id is reused once it is released.
+            static void releaseElement(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                IRenderElement* pElement = binding::unwrap<IRenderElement>(args.This());
+                if (pElement)
+                {
+                    m_pEnvironment->executeCommands();
+                    m_pEnvironment->destroyElement(pElement);
+                    args.This()->SetAlignedPointerInInternalField(0, nullptr);
+                    args.This()->SetInternalField(1, v8::Integer::New(pIsolate, 0));
+                }
+            }
+
+            // Elements created by scripts are owned by their wrapper, which
+            // is weak: once it is collected the element is destroyed, unless
+            // it is still part of a tree. Such orphans are then owned by the
+            // tree and destroyed when they are removed from it or their
+            // parent is destroyed.
+            struct ElementRecord
+            {
+                v8::Global<v8::Object> wrapper;
+                Environment* pEnvironment;
+                IRenderElement* pElement;
+                uint32_t id;
+                int64_t nExternalSize;
+            };
+
+            void addElement(v8::Local<v8::Object> wrapper, IRenderElement* pElement, uint32_t id)
+            {
+                std::unique_ptr<ElementRecord>& pRecord = m_elements[pElement];
+                pRecord.reset(new ElementRecord());
+                pRecord->wrapper.Reset(m_pIsolate, wrapper);
+                pRecord->wrapper.SetWeak(pRecord.get(), onElementCollected, v8::WeakCallbackType::kParameter);
+                pRecord->pEnvironment = this;
+                pRecord->pElement = pElement;
+                pRecord->id = id;
+                pRecord->nExternalSize = (int64_t)pElement->getMemoryUsage();
+                m_pIsolate->AdjustAmountOfExternalAllocatedMemory(pRecord->nExternalSize);
+            }
+
+            // Runs during garbage collection, where only the handle may be
+            // touched. The element is destroyed by collectElements().
+            static void onElementCollected(const v8::WeakCallbackInfo<ElementRecord>& data)
+            {
+                ElementRecord* pRecord = data.GetParameter();
+                pRecord->wrapper.Reset();
+                pRecord->pEnvironment->m_vecCollected.push_back(pRecord->pElement);
+            }
+
+            // Destroys an element and the orphans below it, children which
+            // are still referenced by scripts are detached instead.
+            void destroyElement(IRenderElement* pElement)
+            {
+                const IRenderElement::Children children(pElement->getChildren());
+                for (size_t i = 0; i < children.size(); ++i)
+                {
+                    if (m_orphans.count(children[i]))
+                        destroyElement(children[i]);
+                    else
+                        pElement->remove(children[i]);
+                }
+                auto itr = m_elements.find(pElement);
+                if (itr != m_elements.end())
+                {
+                    m_commands.remove(itr->second->id);
+                    m_nReleasedMemory += itr->second->nExternalSize;
+                    m_elements.erase(itr);
+                }
+                m_orphans.erase(pElement);
+                pElement->release();
+            }
+
+            // Destroys the elements whose wrappers were collected, called
+            // between frames once the recorded commands are applied.
+            void collectElements()
+            {
+                const uint32_t nRemoved = m_commands.getRemoved() + m_nRemovedChildren;
+                if (!m_vecCollected.empty() || (nRemoved != m_nLastRemoved && !m_orphans.empty()))
+                {
+                    FLINT_TRACE_SCOPE("Environment::collectElements");
+                    std::vector<IRenderElement*> vecCollected;
+                    vecCollected.swap(m_vecCollected);
+                    for (size_t i = 0; i < vecCollected.size(); ++i)
+                    {
+                        if (vecCollected[i]->getParent())
+                            m_orphans.insert(vecCollected[i]);
+                        else
+                            destroyElement(vecCollected[i]);
+                    }
+                    // Orphans removed from their tree since the last pass.
+                    if (nRemoved != m_nLastRemoved)
+                    {
+                        std::vector<IRenderElement*> vecRoots;
+                        for (auto itr = m_orphans.begin(); itr != m_orphans.end(); ++itr)
+                        {
+                            if ((*itr)->getParent() == nullptr)
+                                vecRoots.push_back(*itr);
+                        }
+                        for (size_t i = 0; i < vecRoots.size(); ++i)
+                            destroyElement(vecRoots[i]);
+                    }
+                }
+                m_nLastRemoved = nRemoved;
+                updateExternalMemory();
+            }
+
+            // Tells V8 about native memory released with elements and held
+            // by layers and images, so its heuristics see the real heap.
+            void updateExternalMemory()
+            {
+                const int64_t nRenderer = m_pRenderer ? m_pRenderer->getExternalMemory() : 0;
+                const int64_t change = nRenderer - m_nRendererMemory - m_nReleasedMemory;
+                m_nRendererMemory = nRenderer;
+                m_nReleasedMemory = 0;
+                if (change != 0)
+                    m_pIsolate->AdjustAmountOfExternalAllocatedMemory(change);
+            }
+
+            static void getElementId(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                args.GetReturnValue().Set(args.This()->GetInternalField(1));
+            }
+
+            void createCommandBuffer(uint32_t capacity)
+            {
+                v8::HandleScope scope(m_pIsolate);
+                // Views of the previous buffer become empty rather than
+                // writing to memory nobody reads.
+                if (!m_commandBuffer.IsEmpty())
+                    m_commandBuffer.Get(m_pIsolate)->Detach();
+                std::shared_ptr<v8::BackingStore> store = v8::ArrayBuffer::NewBackingStore(m_pIsolate, capacity * sizeof(uint32_t));
+                m_pCommands = reinterpret_cast<uint32_t*>(store->Data());
+                m_pCommands[0] = CommandBuffer::HEADER_SIZE;
+                m_nCommandCapacity = capacity;
+                m_commandBuffer.Reset(m_pIsolate, v8::ArrayBuffer::New(m_pIsolate, store));
+            }
+
+            void executeCommands()
+            {
+                if (m_pCommands[0] == CommandBuffer::HEADER_SIZE)
+                    return;
+                const uint32_t nRejected = m_commands.execute(m_pCommands, m_nCommandCapacity);
+                if (nRejected && console::isEnabled(console::Level::WARN))
+                {
+                    char text[64];
+                    const int length = snprintf(text, sizeof(text), "Command buffer: %u invalid commands skipped", nRejected);
+                    console::write(console::Level::WARN, text, (size_t)length);
+                }
+            }
+
+            // Applies the recorded commands now and returns the buffer to
+            // record into. Scripts pass true when the buffer ran full, which
+            // replaces it with a larger one.
+            static void flushCommands(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                m_pEnvironment->executeCommands();
+                if (args[0]->BooleanValue(pIsolate) && m_pEnvironment->m_nCommandCapacity < CommandBuffer::MAXIMUM_CAPACITY)
+                    m_pEnvironment->createCommandBuffer(CommandBuffer::grow(m_pEnvironment->m_nCommandCapacity));
+                args.GetReturnValue().Set(m_pEnvironment->m_commandBuffer.Get(pIsolate));
+            }
+
+            static void layoutElement(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                IRenderElement* pElement = binding::unwrap<IRenderElement>(args.This());
+                if (pElement == nullptr)
+                {
+                    binding::throwError(pIsolate, "layout: object has been released");
+                    return;
+                }
+                if (args[0]->IsObject())
+                {
+                    v8::HandleScope scope(pIsolate);
+                    v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                    v8::Local<v8::Object> params = args[0].As<v8::Object>();
+                    getFlex(pIsolate, context, params, pElement);
+                }
+            }
+
+            static void removeChild(IRenderElement& element, IRenderElement* pChild)
+            {
+                if (pChild->getParent() == &element)
+                {
+                    element.remove(pChild);
+                    ++reinterpret_cast<Environment*>(v8::Isolate::GetCurrent()->GetData(0))->m_nRemovedChildren;
+                }
+            }
+
+            static void setPosition(IRenderElement& element, int32_t x, int32_t y)
+            {
+                element.setPosition(Position(x, y));
+            }
+
+            static double getOpacity(const IRenderElement& element)
+            {
+                return element.getOpacity() / 255.0;
+            }
+
+            static void setOpacity(IRenderElement& element, double opacity)
+            {
+                element.setOpacity(toOpacity(opacity));
+            }
+
+            static unsigned char toOpacity(double opacity)
+            {
+                return (unsigned char)(std::min(std::max(opacity, 0.0), 1.0) * 255 + 0.5);
+            }
+
+            static void fastSetPosition(v8::ApiObject receiver, int32_t x, int32_t y)
+            {
+                IRenderElement* pElement = binding::unwrap<IRenderElement>(receiver);
+                if (pElement)
+                    pElement->setPosition(Position(x, y));
+            }
+
+            static void fastSetOpacity(v8::ApiObject receiver, double opacity)
+            {
+                IRenderElement* pElement = binding::unwrap<IRenderElement>(receiver);
+                if (pElement)
+                    pElement->setOpacity(toOpacity(opacity));
+            }
+
+            static void fastSetRotation(v8::ApiObject receiver, double degree)
+            {
+                IRenderElement* pElement = binding::unwrap<IRenderElement>(receiver);
+                if (pElement)
+                    pElement->setRotation((float)degree);
+            }
+
+            static const FrameStats& getStats(Engine& engine)
+            {
+                return engine.getRenderer()->getLastFrameStats();
+            }
+
+            // startProfile(path) records a CPU profile, startProfile({cpu,
+            // heap}) a CPU profile, sampled allocations or both. The files
+            // are written by stopProfile.
+            static void startProfile(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                v8::HandleScope scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                std::string cpu, heap;
+                auto getPath = [&](v8::Local<v8::Value> value, std::string& path)
+                {
+                    if (!value->IsNullOrUndefined())
+                        path = *v8::String::Utf8Value(pIsolate, value);
+                };
+                v8::Local<v8::Value> value;
+                if (args[0]->IsObject())
+                {
+                    v8::Local<v8::Object> options = args[0].As<v8::Object>();
+                    if (options->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "cpu")).ToLocal(&value))
+                        getPath(value, cpu);
+                    if (options->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "heap")).ToLocal(&value))
+                        getPath(value, heap);
+                }
+                else if (args[0]->IsNullOrUndefined())
+                    cpu = "flint.cpuprofile";
+                else
+                    getPath(args[0], cpu);
+                Profiler& profiler = *m_pEnvironment->m_pProfiler;
+                const bool bStarted = (!cpu.empty() || !heap.empty()) && (cpu.empty() || profiler.startCpu(cpu)) && (heap.empty() || profiler.startHeapSampling(heap));
+                args.GetReturnValue().Set(bStarted);
+            }
+
+            static void stopProfile(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (args.GetIsolate()->GetData(0));
+                args.GetReturnValue().Set(m_pEnvironment->m_pProfiler->isProfiling() && m_pEnvironment->m_pProfiler->stop());
+            }
+
+            static void writeHeapSnapshot(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                const std::string path = args[0]->IsNullOrUndefined() ? "flint.heapsnapshot" : *v8::String::Utf8Value(pIsolate, args[0]);
+                args.GetReturnValue().Set(Profiler::writeHeapSnapshot(pIsolate, path));
+            }
+
+            static const GCStats& getGCStats(Engine&)
+            {
+                return reinterpret_cast<Environment*>(v8::Isolate::GetCurrent()->GetData(0))->m_gcStats;
+            }
+
+            // print and console.log, info, warn and error join their
+            // arguments with spaces into the console's ring buffer, UTF-8
+            // as V8 writes it.
+            template <console::Level L>
+            static void log(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                if (!console::isEnabled(L))
+                    return;
+                v8::Isolate* pIsolate = args.GetIsolate();
+                v8::HandleScope handle_scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                char buffer[console::MAX_MESSAGE];
+                size_t length = 0;
+                for (int i = 0; i < args.Length() && length < sizeof(buffer); ++i)
+                {
+                    if (i > 0)
+                        buffer[length++] = ' ';
+                    v8::Local<v8::String> str;
+                    if (!toLogString(pIsolate, context, args[i]).ToLocal(&str))
+                        return;
+                    length += str->WriteUtf8(pIsolate, buffer + length, (int)(sizeof(buffer) - length), nullptr, v8::String::NO_NULL_TERMINATION | v8::String::REPLACE_INVALID_UTF8);
+                }
+                console::write(L, buffer, length);
+            }
+
+            static void print(const v8::FunctionCallbackInfo<v8::Value>& args) { log<console::Level::LOG>(args); }
+
+            // Values whose conversion throws, symbols or objects with a
+            // throwing toString(), are logged as Symbol(description) or by
+            // their type. Empty only when execution was terminated.
+            static v8::MaybeLocal<v8::String> toLogString(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value)
+            {
+                v8::TryCatch try_catch(pIsolate);
+                v8::Local<v8::String> str;
+                if (value->ToString(context).ToLocal(&str))
+                    return str;
+                if (try_catch.HasTerminated())
+                {
+                    try_catch.ReThrow();
+                    return v8::MaybeLocal<v8::String>();
+                }
+                if (!value->IsSymbol())
+                    return value->TypeOf(pIsolate);
+                v8::Local<v8::Value> description = value.As<v8::Symbol>()->Description(pIsolate);
+                str = v8::String::NewFromUtf8Literal(pIsolate, "Symbol(");
+                if (description->IsString())
+                    str = v8::String::Concat(pIsolate, str, description.As<v8::String>());
+                return v8::String::Concat(pIsolate, str, v8::String::NewFromUtf8Literal(pIsolate, ")"));
+            }
+
+            struct FrameCallback
+            {
+                uint32_t id;
+                v8::Global<v8::Function> callback;
+            };
+
+            // The fs global reads files, their metadata and directories on
+            // the I/O pool. Requests settle their promise at the start of the
+            // tick after they completed, the loop is woken for it. Data is
+            // handed to V8 in the buffers it was read into: file contents as
+            // ArrayBuffer backing stores, text as external strings decoded
+            // on the I/O thread.
+            enum class FileOperation
+            {
+                READ,
+                READ_TEXT,
+                STAT,
+                LIST
+            };
+
+            struct FileRequest
+            {
+                FileRequest() : bDone(false), bSucceeded(false), pData(nullptr), size(0), pText(nullptr), length(0) {}
+                ~FileRequest()
+                {
+                    free(pData);
+                    free(pText);
+                }
+
+                FileOperation operation;
+                std::wstring path;
+                v8::Global<v8::Promise::Resolver> resolver;
+                std::atomic<bool> bDone;
+                bool bSucceeded;
+                char* pData;		// READ and ASCII READ_TEXT
+                size_t size;
+                uint16_t* pText;	// other READ_TEXT
+                size_t length;
+                platform::FileInfo info;
+                std::vector<platform::DirectoryEntry> vecEntries;
+            };
+
+            // Owns a malloc() block for an external string.
+            template <typename Base, typename Char>
+            class HeapSource : public Base
+            {
+            public:
+
+                HeapSource(Char* pData, size_t length) : m_pData(pData), m_nLength(length) {}
+                ~HeapSource() override { free(m_pData); }
+
+                const Char* data() const override { return m_pData; }
+                size_t length() const override { return m_nLength; }
+
+            private:
+
+                Char* m_pData;
+                size_t m_nLength;
+            };
+
+            static void freeBackingStore(void* data, size_t, void*)
+            {
+                free(data);
+            }
+
+            static void readFile(const v8::FunctionCallbackInfo<v8::Value>& args) { requestFile(FileOperation::READ, args); }
+            static void readText(const v8::FunctionCallbackInfo<v8::Value>& args) { requestFile(FileOperation::READ_TEXT, args); }
+            static void stat(const v8::FunctionCallbackInfo<v8::Value>& args) { requestFile(FileOperation::STAT, args); }
+            static void readDir(const v8::FunctionCallbackInfo<v8::Value>& args) { requestFile(FileOperation::LIST, args); }
+
+            // Relative paths start in the working directory.
+            static void requestFile(FileOperation operation, const v8::FunctionCallbackInfo<v8::Value>& args)
             {
-                v8::Isolate::Scope isolate_scope(m_pIsolate);
-                v8::HandleScope handle_scope(m_pIsolate);
-                v8::Local<v8::Context> context = v8::Context::New(m_pIsolate);
-                v8::Context::Scope context_scope(context);
-                v8::Local<v8::String> source = v8::String::NewFromUtf8(m_pIsolate, code, v8::NewStringType::kNormal).ToLocalChecked();
-                v8::Local<v8::Script> script = v8::Script::Compile(context, source).ToLocalChecked();
-                // Run the script to get the result.
-                v8::Local<v8::Value> result = script->Run(context).ToLocalChecked();
-                if (result.IsEmpty())
-                    int k = 0;
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                v8::HandleScope scope(pIsolate);
+                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
+                v8::Local<v8::String> path;
+                v8::Local<v8::Promise::Resolver> resolver;
+                if (!args[0]->ToString(context).ToLocal(&path) || !v8::Promise::Resolver::New(context).ToLocal(&resolver))
+                    return;
+                v8::String::Value value(pIsolate, path);
+                std::unique_ptr<FileRequest> pRequest(new FileRequest());
+                pRequest->operation = operation;
+                pRequest->path = platform::resolvePath(m_pEnvironment->m_baseDirectory.c_str(), std::wstring(reinterpret_cast<const wchar_t*>(*value), value.length()).c_str());
+                pRequest->resolver.Reset(pIsolate, resolver);
+                FileRequest* pPending = pRequest.get();
+                m_pEnvironment->m_vecFileRequests.push_back(std::move(pRequest));
+                ThreadPool::GetIO().run(m_pEnvironment->m_fileRequests, [pPending]()
+                {
+                    FLINT_TRACE_SCOPE("Environment::performFileRequest");
+                    performFileRequest(*pPending);
+                    pPending->bDone.store(true, std::memory_order_release);
+                    platform::wake();
+                });
+                args.GetReturnValue().Set(resolver->GetPromise());
             }
 
-            v8::MaybeLocal<v8::Module> load(const wchar_t* moduleName, const char* code = 0)
+            // Runs on the I/O pool.
+            static void performFileRequest(FileRequest& request)
             {
-                v8::EscapableHandleScope handle_scope(m_pIsolate);
-                v8::TryCatch try_catch(m_pIsolate);
-                v8::Local<v8::String> source;
-                std::wstring moduleNameFull;
-                std::wstring modulePathFull;
-                bool bLoaded = true;
-                if (code)
-                    v8::String::NewFromUtf8(m_pIsolate, code).ToLocal(&source);
-                else if(0 == _wcsicmp(moduleName, L"flint"))
-                    v8::String::NewFromUtf8(m_pIsolate, FlintModule).ToLocal(&source);
-                else
+                switch (request.operation)
                 {
-                    modulePathFull = m_currPath.top();
-                    modulePathFull.push_back('\\');
-                    modulePathFull += moduleName;
-                    modulePathFull = platform::getFullPath(modulePathFull.c_str());
-                    moduleNameFull = modulePathFull + L"\\" + platform::getFileName(moduleName);
-                    v8::MaybeLocal<v8::String> code = readFile(moduleNameFull.c_str());
-                    bLoaded = code.ToLocal(&source);
-                }
-                if (bLoaded)
-                {
-                    std::unique_ptr<char> filename(toUTF8(moduleNameFull.c_str()));
-                    v8::Local<v8::String> name = v8::String::NewFromUtf8(m_pIsolate, filename.get()).ToLocalChecked();
-                    v8::ScriptOrigin origin(m_pIsolate, name, 0, 0, false, -1, v8::Local<v8::Value>(), false, false, true);
-                    v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
-                    v8::Local<v8::Module> module;
-                    v8::ScriptCompiler::Source compiler(source, origin);
-                    if (!v8::ScriptCompiler::CompileModule(m_pIsolate, &compiler).ToLocal(&module))
-                        reportException(&try_catch);
-                    else
+                case FileOperation::READ:
+                    request.pData = platform::readFile(request.path.c_str(), request.size);
+                    request.bSucceeded = request.pData != nullptr;
+                    break;
+                case FileOperation::READ_TEXT:
+                {
+                    request.pData = platform::readFile(request.path.c_str(), request.size);
+                    request.bSucceeded = request.pData != nullptr;
+                    if (!request.bSucceeded || isAscii(request.pData, request.size))
+                        break;
+                    const char* pText = request.pData;
+                    int size = (int)request.size;
+                    if (size >= 3 && memcmp(pText, "\xEF\xBB\xBF", 3) == 0)
                     {
-                        auto itr = Modules.insert(std::make_pair(filename.get(), v8::Eternal<v8::Module>(m_pIsolate, module))).first;
-                        m_currPath.push(modulePathFull);
-                        if (module->InstantiateModule(context, resolveModules).IsNothing())
-                        {
-                            Modules.erase(itr);
-                            m_currPath.pop();
-                            reportException(&try_catch);
-                        }
-                        else
-                        {
-                            m_currPath.pop();
-                            v8::Local<v8::Promise> promise = module->Evaluate(context).ToLocalChecked().As<v8::Promise>();
-                            if (v8::Module::kEvaluated == module->GetStatus() && promise->State() == v8::Promise::kFulfilled)
-                            {
-                                if (moduleName[0] == 0)
-                                {
-                                    v8::Local<v8::Object> ns = module->GetModuleNamespace()->ToObject(context).ToLocalChecked();
-                                    v8::Local<v8::Value> result = ns->Get(context, v8::String::NewFromUtf8Literal(m_pIsolate, "res")).ToLocalChecked();
-                                    if (result->IsObject())
-                                    {
-                                        v8::Local<v8::Object> obj = result->ToObject(context).ToLocalChecked();
-                                        v8::Local<v8::Value> processFunc = obj->Get(context, v8::String::NewFromUtf8Literal(m_pIsolate, "update")).ToLocalChecked();
-                                        if (processFunc->IsFunction())
-                                        {
-                                            Application.Set(m_pIsolate, obj);
-                                            ProcessFunc.Set(m_pIsolate, v8::Local<v8::Function>::Cast(processFunc));
-                                        }
-                                    }
-                                }
-                                return handle_scope.EscapeMaybe(v8::MaybeLocal<v8::Module>(module));
-                            }
-                            else
-                            {
-                                Modules.erase(itr);
-                                reportException(&try_catch);
-                            }
-                        }
+                        pText += 3;
+                        size -= 3;
                     }
+                    const int length = MultiByteToWideChar(CP_UTF8, 0, pText, size, NULL, 0);
+                    request.pText = (uint16_t*)malloc((length ? length : 1) * sizeof(uint16_t));
+                    MultiByteToWideChar(CP_UTF8, 0, pText, size, reinterpret_cast<wchar_t*>(request.pText), length);
+                    request.length = (size_t)length;
+                    free(request.pData);
+                    request.pData = nullptr;
+                    break;
+                }
+                case FileOperation::STAT:
+                    request.bSucceeded = platform::getFileInfo(request.path.c_str(), request.info);
+                    break;
+                case FileOperation::LIST:
+                    request.bSucceeded = platform::listDirectory(request.path.c_str(), request.vecEntries);
+                    break;
                 }
-                return v8::MaybeLocal<v8::Module>();
             }
 
-            static void getSize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Object>& params, Size& size)
+            // Called every tick, settles the completed file requests.
+            void processFileRequests()
             {
-                v8::Local<v8::Value> value;
-                if (params->GetRealNamedProperty(context, v8::String::NewFromUtf8Literal(pIsolate, "size")).ToLocal(&value))
+                if (m_vecFileRequests.empty())
+                    return;
+                v8::HandleScope scope(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                for (size_t i = 0; i < m_vecFileRequests.size();)
                 {
-                    int32_t width = size.width, height = size.height;
-                    if (value->IsArray())
+                    FileRequest& request = *m_vecFileRequests[i];
+                    if (!request.bDone.load(std::memory_order_acquire))
                     {
-                        v8::Local<v8::Array> szArray = v8::Handle<v8::Array>::Cast(value);
-                        if (szArray->Length() > 1)
-                        {
-                            width = szArray->Get(context, 0).ToLocalChecked()->Int32Value(context).ToChecked();
-                            height = szArray->Get(context, 1).ToLocalChecked()->Int32Value(context).ToChecked();
-                        }
+                        ++i;
+                        continue;
                     }
-                    else if (value->IsObject())
+                    FLINT_TRACE_SCOPE("Environment::settleFileRequest");
+                    v8::Local<v8::Promise::Resolver> resolver = request.resolver.Get(m_pIsolate);
+                    v8::Local<v8::Value> result;
+                    if (request.bSucceeded)
+                        result = getFileResult(context, request);
+                    if (result.IsEmpty())
                     {
-                        v8::Local<v8::Object> szObject = v8::Handle<v8::Object>::Cast(value);
-                        auto w = v8::String::NewFromUtf8Literal(pIsolate, "width");
-                        auto h = v8::String::NewFromUtf8Literal(pIsolate, "height");
-                        if (szObject->Has(context, w).IsJust() && szObject->Has(context, h).IsJust())
-                        {
-                            width = szObject->Get(context, w).ToLocalChecked()->Int32Value(context).ToChecked();
-                            height = szObject->Get(context, h).ToLocalChecked()->Int32Value(context).ToChecked();
-                        }
+                        std::unique_ptr<char> path(toUTF8(request.path.c_str()));
+                        const std::string message = std::string("Unable to read ") + path.get();
+                        resolver->Reject(context, v8::Exception::Error(v8::String::NewFromUtf8(m_pIsolate, message.c_str()).ToLocalChecked())).Check();
                     }
-                    size.width = (Size::Type)std::max<int32_t>(width, 0);
-                    size.height = (Size::Type)std::max<int32_t>(height, 0);
+                    else
+                        resolver->Resolve(context, result).Check();
+                    m_vecFileRequests.erase(m_vecFileRequests.begin() + i);
                 }
             }
 
-            static void getPosition(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Object>& params, Position& position)
+            v8::Local<v8::Value> getFileResult(v8::Local<v8::Context> context, FileRequest& request)
             {
-                v8::Local<v8::Value> value;
-                if (params->GetRealNamedProperty(context, v8::String::NewFromUtf8Literal(pIsolate, "position")).ToLocal(&value))
+                switch (request.operation)
                 {
-                    if (value->IsArray())
+                case FileOperation::READ:
+                {
+                    std::unique_ptr<v8::BackingStore> store = v8::ArrayBuffer::NewBackingStore(request.pData, request.size, freeBackingStore, nullptr);
+                    request.pData = nullptr;
+                    return v8::ArrayBuffer::New(m_pIsolate, std::move(store));
+                }
+                case FileOperation::READ_TEXT:
+                {
+                    v8::MaybeLocal<v8::String> text;
+                    if (request.pText && request.length)
                     {
-                        v8::Local<v8::Array> szArray = v8::Handle<v8::Array>::Cast(value);
-                        if (szArray->Length() > 1)
-                        {
-                            position.x = (Position::Type)szArray->Get(context, 0).ToLocalChecked()->Int32Value(context).ToChecked();
-                            position.y = (Position::Type)szArray->Get(context, 1).ToLocalChecked()->Int32Value(context).ToChecked();
-                        }
+                        HeapSource<v8::String::ExternalStringResource, uint16_t>* pSource = new HeapSource<v8::String::ExternalStringResource, uint16_t>(request.pText, request.length);
+                        request.pText = nullptr;
+                        text = v8::String::NewExternalTwoByte(m_pIsolate, pSource);
+                        if (text.IsEmpty())
+                            delete pSource;
                     }
-                    else if (value->IsObject())
+                    else if (request.pData && request.size)
                     {
-                        v8::Local<v8::Object> szPosition = v8::Handle<v8::Object>::Cast(value);
-                        auto x = v8::String::NewFromUtf8Literal(pIsolate, "x");
-                        auto y = v8::String::NewFromUtf8Literal(pIsolate, "y");
-                        if (szPosition->Has(context, x).IsJust() && szPosition->Has(context, y).IsJust())
-                        {
-                            position.x = (Position::Type)szPosition->Get(context, x).ToLocalChecked()->Int32Value(context).ToChecked();
-                            position.y = (Position::Type)szPosition->Get(context, y).ToLocalChecked()->Int32Value(context).ToChecked();
-                        }
+                        HeapSource<v8::String::ExternalOneByteStringResource, char>* pSource = new HeapSource<v8::String::ExternalOneByteStringResource, char>(request.pData, request.size);
+                        request.pData = nullptr;
+                        text = v8::String::NewExternalOneByte(m_pIsolate, pSource);
+                        if (text.IsEmpty())
+                            delete pSource;
+                    }
+                    else
+                        text = v8::String::Empty(m_pIsolate);
+                    v8::Local<v8::String> result;
+                    return text.ToLocal(&result) ? result.As<v8::Value>() : v8::Local<v8::Value>();
+                }
+                case FileOperation::STAT:
+                {
+                    v8::Local<v8::Object> info = v8::Object::New(m_pIsolate);
+                    info->Set(context, v8::String::NewFromUtf8Literal(m_pIsolate, "size"), v8::Number::New(m_pIsolate, (double)request.info.size)).Check();
+                    info->Set(context, v8::String::NewFromUtf8Literal(m_pIsolate, "modified"), v8::Number::New(m_pIsolate, request.info.modified)).Check();
+                    info->Set(context, v8::String::NewFromUtf8Literal(m_pIsolate, "isDirectory"), v8::Boolean::New(m_pIsolate, request.info.bDirectory)).Check();
+                    return info;
+                }
+                default:
+                {
+                    v8::Local<v8::Array> entries = v8::Array::New(m_pIsolate, (int)request.vecEntries.size());
+                    v8::Local<v8::String> name = v8::String::NewFromUtf8Literal(m_pIsolate, "name");
+                    v8::Local<v8::String> isDirectory = v8::String::NewFromUtf8Literal(m_pIsolate, "isDirectory");
+                    for (size_t i = 0; i < request.vecEntries.size(); ++i)
+                    {
+                        const platform::DirectoryEntry& entry = request.vecEntries[i];
+                        v8::Local<v8::Object> object = v8::Object::New(m_pIsolate);
+                        object->Set(context, name, v8::String::NewFromTwoByte(m_pIsolate, reinterpret_cast<const uint16_t*>(entry.name.c_str()), v8::NewStringType::kNormal, (int)entry.name.size()).ToLocalChecked()).Check();
+                        object->Set(context, isDirectory, v8::Boolean::New(m_pIsolate, entry.bDirectory)).Check();
+                        entries->Set(context, (uint32_t)i, object).Check();
                     }
+                    return entries;
+                }
                 }
             }
 
-            static void __f_init(const v8::FunctionCallbackInfo<v8::Value>& args)
+            // Where microtasks run: after the application loaded, after an
+            // input event, after the update callbacks and timers of a tick
+            // and before the frame is laid out.
+            enum class Checkpoint
             {
-                v8::Isolate* pIsolate = args.GetIsolate();
-                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
-                Engine& engine = m_pEnvironment->m_engine;
-                v8::HandleScope scope(pIsolate);
-                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
-                EngineParameters& engineParams = engine.getParameters();
-                if (args.Length() > 0 && args[0]->IsObject())
+                LOAD,
+                INPUT,
+                TIMERS,
+                LAYOUT
+            };
+
+            // Load and input checkpoints always run, as does the first one of
+            // a tick. Later ones are skipped once the tick spent its budget,
+            // pending microtasks then wait for the next tick. A checkpoint
+            // runs until the queue is empty, so the budget bounds the work
+            // started, not a single long promise chain.
+            void runMicrotasks(Checkpoint checkpoint)
+            {
+                const float budget = m_engine.getParameters().microtaskBudget;
+                FrameStats* pStats = m_pRenderer ? &m_pRenderer->getStats() : nullptr;
+                if (checkpoint == Checkpoint::TIMERS || checkpoint == Checkpoint::LAYOUT)
                 {
-                    v8::Local<v8::Object> params = args[0]->ToObject(context).ToLocalChecked();
-                    getSize(pIsolate, context, params, engineParams.size);
-                    v8::Local<v8::Value> value;
-                    if (params->GetRealNamedProperty(context, v8::String::NewFromUtf8Literal(pIsolate, "title")).ToLocal(&value))
-                    {
-                        v8::String::Utf8Value val(pIsolate, value->ToString(context).ToLocalChecked());
-                        std::unique_ptr<wchar_t> str(toWideChar(*val));
-                        engineParams.title = str.get();
-                    }
-                    if (params->GetRealNamedProperty(context, v8::String::NewFromUtf8Literal(pIsolate, "state")).ToLocal(&value))
+                    if (budget > 0.0f && m_bMicrotasksRan && m_fMicrotaskTime >= budget)
                     {
-                        const uint32_t state = value->Int32Value(context).FromJust();
-                        if (state <= (int)EngineState::MAXIMIZED)
-                            engineParams.state = (EngineState)state;
+                        m_bMicrotasksDeferred = true;
+                        if (pStats)
+                            ++pStats->microtaskDeferrals;
+                        return;
                     }
+                    m_bMicrotasksRan = true;
+                }
+                FLINT_TRACE_SCOPE("Environment::runMicrotasks");
+                Stopwatch watch;
+                m_pIsolate->PerformMicrotaskCheckpoint();
+                const float time = watch.lap();
+                m_fMicrotaskTime += time;
+                m_bMicrotasksDeferred = false;
+                if (pStats)
+                {
+                    ++pStats->microtaskCheckpoints;
+                    pStats->microtasks += time;
                 }
-                v8::Local<v8::Array> result = v8::Array::New(pIsolate, 4);
-                result->Set(context, 0, v8::Integer::NewFromUnsigned(pIsolate, engineParams.size.width));
-                result->Set(context, 1, v8::Integer::NewFromUnsigned(pIsolate, engineParams.size.height));
-                result->Set(context, 2, v8::String::NewFromTwoByte(pIsolate, (const uint16_t*)engineParams.title.c_str()).ToLocalChecked());
-                result->Set(context, 3, v8::Integer::NewFromUnsigned(pIsolate, (uint32_t)engineParams.state));
-                args.GetReturnValue().Set(result);
             }
 
-            static void __f_app(const v8::FunctionCallbackInfo<v8::Value>& args)
+            // A new tick starts with the full budget.
+            void resetMicrotaskBudget()
+            {
+                m_fMicrotaskTime = 0;
+                m_bMicrotasksRan = false;
+            }
+
+            static void queueMicrotask(const v8::FunctionCallbackInfo<v8::Value>& args)
             {
                 v8::Isolate* pIsolate = args.GetIsolate();
-                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
-                Engine& engine = m_pEnvironment->m_engine;
-                v8::HandleScope scope(pIsolate);
-                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
-                const uint32_t type = args[0]->Int32Value(context).FromJust();
-                switch (type)
-                {
-                case 0:
+                if (!args[0]->IsFunction())
                 {
-                    v8::String::Utf8Value value(pIsolate, args[1]->ToString(context).ToLocalChecked());
-                    std::unique_ptr<wchar_t> str(toWideChar(*value));
-                    engine.setTitle(str.get());
+                    binding::throwError(pIsolate, "queueMicrotask expects a function");
+                    return;
                 }
-                break;
-                case 1:
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                pIsolate->EnqueueMicrotask(args[0].As<v8::Function>());
+                if (m_pEnvironment->m_pRenderer)
+                    ++m_pEnvironment->m_pRenderer->getStats().queuedMicrotasks;
+            }
+
+            static float getMicrotaskBudget(Engine& engine)
+            {
+                return engine.getParameters().microtaskBudget;
+            }
+
+            static void setMicrotaskBudget(Engine& engine, float budget)
+            {
+                engine.getParameters().microtaskBudget = std::max(budget, 0.0f);
+            }
+
+            static void setInterval(const v8::FunctionCallbackInfo<v8::Value>& args) { setTimer(true, args); }
+            static void setTimeout(const v8::FunctionCallbackInfo<v8::Value>& args) { setTimer(false, args); }
+
+            static void setTimer(bool bRepeat, const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                if (args.Length() < 1 || !args[0]->IsFunction())
                 {
-                    const uint32_t state = args[1]->Uint32Value(context).FromJust();
-                    if (state <= (int)EngineState::MAXIMIZED)
-                        engine.setState((EngineState)state);
+                    binding::throwError(pIsolate, bRepeat ? "setInterval: callback must be a function" : "setTimeout: callback must be a function");
+                    return;
                 }
-                break;
-                case 3:
+                double delay = 0.0;
+                if (args.Length() > 1 && !args[1]->NumberValue(pIsolate->GetCurrentContext()).To(&delay))
+                    return;
+                const uint32_t id = m_pEnvironment->m_timers.add(delay, bRepeat);
+                m_pEnvironment->m_timerCallbacks[id].Reset(pIsolate, args[0].As<v8::Function>());
+                args.GetReturnValue().Set(id);
+            }
+
+            static void removeTimer(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                uint32_t id;
+                if (args.Length() > 0 && args[0]->IsNumber() && args[0]->Uint32Value(pIsolate->GetCurrentContext()).To(&id) && m_pEnvironment->m_timers.remove(id))
+                    m_pEnvironment->m_timerCallbacks.erase(id);
+            }
+
+            static void requestAnimationFrame(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
+                if (args.Length() < 1 || !args[0]->IsFunction())
                 {
-                    const int32_t width = std::max<int32_t>(args[1]->Int32Value(context).FromJust(), 0);
-                    const int32_t height = std::max<int32_t>(args[2]->Int32Value(context).FromJust(), 0);
-                    engine.setSize(Size((Size::Type)width, (Size::Type)height));
-                }
-                break;
-                case 4:
-                    engine.quit();
-                    break;
-                case 5:
-                    engine.close();
-                    break;
+                    binding::throwError(pIsolate, "requestAnimationFrame: callback must be a function");
+                    return;
                 }
+                uint32_t id = ++m_pEnvironment->m_nLastFrameCallback;
+                if (id == 0)
+                    id = ++m_pEnvironment->m_nLastFrameCallback;
+                m_pEnvironment->m_vecFrameCallbacks.emplace_back();
+                FrameCallback& frameCallback = m_pEnvironment->m_vecFrameCallbacks.back();
+                frameCallback.id = id;
+                frameCallback.callback.Reset(pIsolate, args[0].As<v8::Function>());
+                args.GetReturnValue().Set(id);
             }
 
-            static void __f_elem(const v8::FunctionCallbackInfo<v8::Value>& args)
+            static void cancelAnimationFrame(const v8::FunctionCallbackInfo<v8::Value>& args)
             {
                 v8::Isolate* pIsolate = args.GetIsolate();
                 Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
-                v8::HandleScope scope(pIsolate);
-                v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
-                const int32_t val = args[0]->Int32Value(context).ToChecked();
-                if (!args[1]->IsObject())
+                uint32_t id;
+                if (args.Length() < 1 || !args[0]->IsNumber() || !args[0]->Uint32Value(pIsolate->GetCurrentContext()).To(&id) || id == 0)
                     return;
-                v8::Local<v8::External> pObject = v8::Local<v8::External>::Cast(args[1]->ToObject(context).ToLocalChecked()->GetInternalField(0));
-                switch (val)
-                {
-                case 1:
+                // Callbacks of the frame being run are only reset, the
+                // batch is iterated by index.
+                for (size_t i = 0; i < m_pEnvironment->m_vecFrameBatch.size(); ++i)
                 {
-                    void* pChild = v8::Local<v8::External>::Cast(args[2]->ToObject(context).ToLocalChecked()->GetInternalField(0))->Value();
-                    reinterpret_cast<IRenderElement*> (pObject->Value())->add((IRenderElement*)pChild);
-                    break;
+                    if (m_pEnvironment->m_vecFrameBatch[i].id == id)
+                    {
+                        m_pEnvironment->m_vecFrameBatch[i].callback.Reset();
+                        return;
+                    }
                 }
-                case 2:
+                std::vector<FrameCallback>& callbacks = m_pEnvironment->m_vecFrameCallbacks;
+                for (size_t i = 0; i < callbacks.size(); ++i)
                 {
-                    reinterpret_cast<IRenderElement*> (pObject->Value())->release();
-                    pObject.Clear();
-                    break;
+                    if (callbacks[i].id == id)
+                    {
+                        callbacks.erase(callbacks.begin() + i);
+                        return;
+                    }
                 }
+            }
+
+            // Runs the animation frame callbacks requested before the frame,
+            // those requested by the callbacks run on the next one.
+            void runFrameCallbacks(double timestamp)
+            {
+                if (m_vecFrameCallbacks.empty())
+                    return;
+                FLINT_TRACE_SCOPE("Environment::runFrameCallbacks");
+                v8::HandleScope scope(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                m_vecFrameBatch.swap(m_vecFrameCallbacks);
+                v8::Local<v8::Value> args[] = { v8::Number::New(m_pIsolate, timestamp) };
+                for (size_t i = 0; i < m_vecFrameBatch.size(); ++i)
+                {
+                    if (m_vecFrameBatch[i].callback.IsEmpty())
+                        continue;
+                    v8::Local<v8::Function> callback = m_vecFrameBatch[i].callback.Get(m_pIsolate);
+                    v8::TryCatch try_catch(m_pIsolate);
+                    if (trace::isEnabled())
+                    {
+                        v8::String::Utf8Value name(m_pIsolate, callback->GetDebugName());
+                        trace::begin(trace::intern((*name && **name) ? *name : "requestAnimationFrame"));
+                    }
+                    v8::MaybeLocal<v8::Value> result = callback->Call(context, context->Global(), 1, args);
+                    if (trace::isEnabled())
+                        trace::end();
+                    if (result.IsEmpty())
+                        reportException(&try_catch);
                 }
+                m_vecFrameBatch.clear();
             }
 
-            static void __f_new(const v8::FunctionCallbackInfo<v8::Value>& args)
+            // Worker objects hold their record as an aligned pointer, the
+            // record keeps the object alive until the worker is terminated
+            // or closes and its last messages are delivered.
+            struct WorkerRecord
+            {
+                v8::Global<v8::Object> object;
+                std::unique_ptr<Worker> pWorker;
+            };
+
+            // new Worker(path) starts the module at path, resolved like an
+            // import of the calling script.
+            static void newWorker(const v8::FunctionCallbackInfo<v8::Value>& args)
             {
                 v8::Isolate* pIsolate = args.GetIsolate();
+                if (!args.IsConstructCall())
+                {
+                    binding::throwError(pIsolate, "Worker must be called with new");
+                    return;
+                }
                 Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
                 v8::HandleScope scope(pIsolate);
                 v8::Local<v8::Context> context = pIsolate->GetCurrentContext();
-                const int32_t val = args[0]->Int32Value(context).ToChecked();
-                switch (val)
-                {
-                case 1:
+                v8::Local<v8::String> specifier;
+                if (!args[0]->ToString(context).ToLocal(&specifier))
+                    return;
+                std::wstring directory = m_pEnvironment->m_baseDirectory;
+                v8::Local<v8::StackTrace> stack = v8::StackTrace::CurrentStackTrace(pIsolate, 1);
+                if (stack->GetFrameCount() > 0)
                 {
-                    v8::Local<v8::Object> value = m_pEnvironment->m_elemTemplate.Get(pIsolate)->NewInstance(context).ToLocalChecked();
-                    IRenderElement* pElement = new IRenderElement(*m_pEnvironment->m_pRenderer);
-                    value->SetInternalField(0, v8::External::New(pIsolate, pElement));
-                    args.GetReturnValue().Set(value);
-                    if (args[2]->IsObject())
+                    v8::Local<v8::String> name = stack->GetFrame(pIsolate, 0)->GetScriptName();
+                    if (!name.IsEmpty() && name->Length() > 0)
                     {
-                        v8::Local<v8::Object> params = args[2]->ToObject(context).ToLocalChecked();
-                        Size size = pElement->getSize();
-                        getSize(pIsolate, context, params, size);
-                        Position position = pElement->getPosition();
-                        getPosition(pIsolate, context, params, position);
-                        v8::Local<v8::Value> color;
-                        pElement->setPosition(position);
-                        pElement->setSize(size);
-                        if (params->GetRealNamedProperty(context, v8::String::NewFromUtf8Literal(pIsolate, "backgroundColor")).ToLocal(&color))
-                            pElement->setBackgroundColor(Color(color->Uint32Value(context).ToChecked()));
+                        v8::String::Value value(pIsolate, name);
+                        directory = m_pEnvironment->getDirectory(std::wstring(reinterpret_cast<const wchar_t*>(*value), value.length()));
                     }
                 }
-                break;
-                }
+                std::unique_ptr<WorkerRecord> pRecord(new WorkerRecord());
+                pRecord->object.Reset(pIsolate, args.This());
+                pRecord->pWorker.reset(new Worker(m_pEnvironment->m_pPlatform.get(), m_pEnvironment->m_createParams.array_buffer_allocator_shared, m_pEnvironment->resolveSpecifier(specifier, directory)));
+                binding::wrap(args.This(), pRecord.get());
+                m_pEnvironment->m_vecWorkers.push_back(std::move(pRecord));
             }
 
-            static void print(const v8::FunctionCallbackInfo<v8::Value>& args)
-			{
-				bool first = true;
-				for (int i = 0; i < args.Length(); ++i)
-				{
-					v8::HandleScope handle_scope(args.GetIsolate());
-					if (first)
-						first = false;
-					else
-						printf(" ");
-					v8::String::Utf8Value str(args.GetIsolate(), args[i]);
-                    std::unique_ptr<wchar_t> buffer(toWideChar(*str));
-					wprintf(buffer.get());
-                }
-				printf("\n");
-				fflush(stdout);
-			}
+            static void postWorkerMessage(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                v8::Isolate* pIsolate = args.GetIsolate();
+                WorkerRecord* pRecord = binding::unwrap<WorkerRecord>(args.This());
+                if (pRecord == nullptr)
+                    return;
+                Worker::Message message;
+                if (Worker::serialize(pIsolate, pIsolate->GetCurrentContext(), args[0], args[1], message))
+                    pRecord->pWorker->postMessage(std::move(message));
+            }
 
-            static void setInterval(const v8::FunctionCallbackInfo<v8::Value>& args) { setTimer(0, args); }
-            static void setTimeout(const v8::FunctionCallbackInfo<v8::Value>& args) { setTimer(1, args); }
+            // True once the worker's thread finished, by close(), an error
+            // or terminate().
+            static void isWorkerClosed(const v8::FunctionCallbackInfo<v8::Value>& args)
+            {
+                WorkerRecord* pRecord = binding::unwrap<WorkerRecord>(args.This());
+                args.GetReturnValue().Set(pRecord == nullptr || pRecord->pWorker->isClosed());
+            }
 
-            static void setTimer(int type, const v8::FunctionCallbackInfo<v8::Value>& args)
+            static void terminateWorker(const v8::FunctionCallbackInfo<v8::Value>& args)
             {
                 v8::Isolate* pIsolate = args.GetIsolate();
                 Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
-                v8::HandleScope scope(pIsolate);
-                v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-                v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-                v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "addTimer")).ToLocalChecked();
-                if (callback->IsFunction() && args.Length() > 1)
+                WorkerRecord* pRecord = binding::unwrap<WorkerRecord>(args.This());
+                if (pRecord == nullptr)
+                    return;
+                args.This()->SetAlignedPointerInInternalField(0, nullptr);
+                m_pEnvironment->removeWorker(pRecord);
+            }
+
+            void removeWorker(WorkerRecord* pRecord)
+            {
+                auto itr = std::find_if(m_vecWorkers.begin(), m_vecWorkers.end(), [pRecord](const std::unique_ptr<WorkerRecord>& pOther) { return pOther.get() == pRecord; });
+                if (itr != m_vecWorkers.end())
+                    m_vecWorkers.erase(itr);
+            }
+
+            // Called every frame, hands the messages posted by the workers
+            // to the onmessage handlers of their objects.
+            void dispatchWorkerMessages()
+            {
+                if (m_vecWorkers.empty())
+                    return;
+                FLINT_TRACE_SCOPE("Environment::dispatchWorkerMessages");
+                v8::HandleScope scope(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                v8::Local<v8::String> onmessage = v8::String::NewFromUtf8Literal(m_pIsolate, "onmessage");
+                v8::Local<v8::String> data = v8::String::NewFromUtf8Literal(m_pIsolate, "data");
+                std::deque<Worker::Message> messages;
+                // Handlers may create or terminate workers, records are
+                // looked up again after every call.
+                for (size_t i = 0; i < m_vecWorkers.size();)
                 {
-                    v8::Local<v8::Value> argPtr[3] = { v8::Integer::New(pIsolate, type), args[0], args[1] };
-                    v8::MaybeLocal<v8::Value> result = v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 3, argPtr);
-                    args.GetReturnValue().Set(result.ToLocalChecked());
+                    WorkerRecord* pRecord = m_vecWorkers[i].get();
+                    const bool bClosed = pRecord->pWorker->isClosed();
+                    if (!pRecord->pWorker->receive(messages))
+                    {
+                        if (bClosed)
+                        {
+                            v8::Local<v8::Object> object = pRecord->object.Get(m_pIsolate);
+                            object->SetAlignedPointerInInternalField(0, nullptr);
+                            m_vecWorkers.erase(m_vecWorkers.begin() + i);
+                        }
+                        else
+                            ++i;
+                        continue;
+                    }
+                    v8::Local<v8::Object> object = pRecord->object.Get(m_pIsolate);
+                    for (; !messages.empty(); messages.pop_front())
+                    {
+                        v8::HandleScope messageScope(m_pIsolate);
+                        v8::TryCatch try_catch(m_pIsolate);
+                        v8::Local<v8::Value> value, callback;
+                        if (!Worker::deserialize(m_pIsolate, context, messages.front()).ToLocal(&value) ||
+                            !object->Get(context, onmessage).ToLocal(&callback))
+                        {
+                            reportException(&try_catch);
+                            continue;
+                        }
+                        if (!callback->IsFunction())
+                            continue;
+                        v8::Local<v8::Object> event = v8::Object::New(m_pIsolate);
+                        event->Set(context, data, value).Check();
+                        v8::Local<v8::Value> args[] = { event };
+                        if (callback.As<v8::Function>()->Call(context, object, 1, args).IsEmpty())
+                            reportException(&try_catch);
+                    }
+                    if (i < m_vecWorkers.size() && m_vecWorkers[i].get() == pRecord)
+                        ++i;
                 }
             }
 
-            static void removeTimer(const v8::FunctionCallbackInfo<v8::Value>& args)
+            // Invokes the callbacks of the timers due now. Timers scheduled
+            // by the callbacks run on a later frame at the earliest.
+            void runTimers()
             {
-                v8::Isolate* pIsolate = args.GetIsolate();
-                Environment* m_pEnvironment = reinterpret_cast<Environment*> (pIsolate->GetData(0));
-                v8::HandleScope scope(pIsolate);
-                v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-                v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-                v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "removeTimer")).ToLocalChecked();
-                if (callback->IsFunction() && args.Length() > 0)
+                const TimerQueue::Clock::time_point now = TimerQueue::Clock::now();
+                const uint64_t limit = m_timers.getSequence();
+                uint32_t id = m_timers.pop(now, limit);
+                if (id == 0)
+                    return;
+                FLINT_TRACE_SCOPE("Environment::runTimers");
+                v8::HandleScope scope(m_pIsolate);
+                v8::Local<v8::Context> context = m_context.Get(m_pIsolate);
+                for (; id != 0; id = m_timers.pop(now, limit))
                 {
-                    v8::Local<v8::Value> argPtr[1] = { args[0] };
-                    v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 1, argPtr);
+                    auto itr = m_timerCallbacks.find(id);
+                    if (itr == m_timerCallbacks.end())
+                        continue;
+                    v8::Local<v8::Function> callback = itr->second.Get(m_pIsolate);
+                    if (!m_timers.contains(id))
+                        m_timerCallbacks.erase(itr);
+                    v8::TryCatch try_catch(m_pIsolate);
+                    if (trace::isEnabled())
+                    {
+                        v8::String::Utf8Value name(m_pIsolate, callback->GetDebugName());
+                        trace::begin(trace::intern((*name && **name) ? *name : "timer"));
+                    }
+                    v8::MaybeLocal<v8::Value> result = callback->Call(context, context->Global(), 0, nullptr);
+                    if (trace::isEnabled())
+                        trace::end();
+                    if (result.IsEmpty())
+                        reportException(&try_catch);
                 }
             }
 
+            // Milliseconds until the next timer is due, negative without timers.
+            double getTimeout()
+            {
+                TimerQueue::Clock::time_point deadline;
+                if (!m_timers.getNextDeadline(deadline))
+                    return -1.0;
+                const std::chrono::duration<double, std::milli> timeout = deadline - TimerQueue::Clock::now();
+                return std::max(timeout.count(), 0.0);
+            }
+
 		private:
 
             v8::Isolate* m_pIsolate;
             v8::Isolate::CreateParams m_createParams;
+            v8::StartupData m_snapshot;
             v8::Eternal<v8::Context> m_context;
             std::unique_ptr<v8::Platform> m_pPlatform;
-			std::map<std::string, v8::Eternal<v8::Module>> Modules;
-            std::stack<std::wstring> m_currPath;
+            std::wstring m_baseDirectory;
+            std::unordered_map<std::wstring, ModuleEntry> m_modules;
+            std::unordered_multimap<int, ModuleEntry*> m_moduleIds;
+            std::unordered_map<std::wstring, std::unique_ptr<StreamedModule>> m_streaming;
+            std::unordered_map<std::wstring, v8::Global<v8::Value>> m_importErrors;
+            std::vector<std::unique_ptr<PendingImport>> m_vecImports;
+            ThreadPool::Group m_imports;
+            std::vector<std::unique_ptr<WorkerRecord>> m_vecWorkers;
+            std::vector<std::unique_ptr<FileRequest>> m_vecFileRequests;
+            ThreadPool::Group m_fileRequests;
             v8::Eternal<v8::ObjectTemplate> m_elemTemplate;
-            v8::Eternal<v8::Object> Application;
-            v8::Eternal<v8::Function> ProcessFunc;
+            binding::Names*             m_pNames;
+            v8::Global<v8::Object>      m_application;
+            v8::Global<v8::Function>    m_update;
+            v8::Global<v8::Function>    m_load;
+            v8::Global<v8::Function>    m_fireEvent;
             Engine&     m_engine;
             Renderer*   m_pRenderer;
+            bool        m_bFastApi;
+            bool        m_bCodeCache;
+            CodeCache   m_codeCache;
+            CommandBuffer               m_commands;
+            v8::Global<v8::ArrayBuffer> m_commandBuffer;
+            uint32_t*                   m_pCommands;
+            uint32_t                    m_nCommandCapacity;
+            TimerQueue                  m_timers;
+            std::unordered_map<uint32_t, v8::Global<v8::Function>> m_timerCallbacks;
+            std::vector<FrameCallback>  m_vecFrameCallbacks;
+            std::vector<FrameCallback>  m_vecFrameBatch;
+            uint32_t                    m_nLastFrameCallback;
+            bool                        m_bContinuous;
+            std::unordered_map<IRenderElement*, std::unique_ptr<ElementRecord>> m_elements;
+            std::unordered_set<IRenderElement*> m_orphans;
+            std::vector<IRenderElement*> m_vecCollected;
+            uint32_t                    m_nRemovedChildren;
+            uint32_t                    m_nLastRemoved;
+            int64_t                     m_nRendererMemory;
+            int64_t                     m_nReleasedMemory;
+            GCPhase                     m_gcPhase;
+            double                      m_gcStart;	// seconds, platform clock
+            GCStats                     m_gcStats;
+            bool                        m_bIdleDone;
+            bool                        m_bTrimmed;
+            std::unique_ptr<Profiler>   m_pProfiler;
+            float                       m_fMicrotaskTime;	// ms spent at checkpoints this tick
+            bool                        m_bMicrotasksRan;
+            bool                        m_bMicrotasksDeferred;
 		};
 	
+        const Environment::Global Environment::Globals[] =
+        {
+            { "print", print },
+            { "setInterval", setInterval },
+            { "setTimeout", setTimeout },
+            { "clearInterval", removeTimer },
+            { "clearTimeout", removeTimer },
+            { "requestAnimationFrame", requestAnimationFrame },
+            { "cancelAnimationFrame", cancelAnimationFrame },
+            { "queueMicrotask", queueMicrotask },
+            { "__f_init", __f_init },
+            { "__f_trace", __f_trace },
+            { nullptr, nullptr }
+        };
+
+        const Environment::Global Environment::ConsoleMethods[] =
+        {
+            { "log", log<console::Level::LOG> },
+            { "info", log<console::Level::INFO> },
+            { "warn", log<console::Level::WARN> },
+            { "error", log<console::Level::ERR> },
+            { nullptr, nullptr }
+        };
+
+        const Environment::Global Environment::FileMethods[] =
+        {
+            { "readFile", readFile },
+            { "readText", readText },
+            { "stat", stat },
+            { "readDir", readDir },
+            { nullptr, nullptr }
+        };
+
 		Interface::Interface(Engine& engine) : m_engine(engine),
                                                m_pEnvironment(new Environment(m_engine))
 		{
@@ -550,40 +2366,104 @@ namespace flint
                         v8::String::Utf8Value pname(pIsolate, str);
                         const std::string name = *pname;
                         std::unique_ptr<char> wname(Environment::toUTF8(main));
-                        const std::string smain = wname.get();
+                        std::string smain;
+                        for (const char* p = wname.get(); *p; ++p)
+                        {
+                            if (*p == '\\' || *p == '\'')
+                                smain += '\\';
+                            smain += *p;
+                        }
                         const std::string code = (name == "default") ? "import defaultExport from '" + smain + "';\nexport let res=new defaultExport();" : "import {" + name + "} from '" + smain + "';\nexport let res=new " + name + "();";
                         m_pEnvironment->load(L"", code.c_str());
-                        return !m_pEnvironment->Application.IsEmpty();
+                        m_pEnvironment->runMicrotasks(Environment::Checkpoint::LOAD);
+                        if (Engine::isDebug() && m_pEnvironment->m_bCodeCache)
+                            m_pEnvironment->m_codeCache.report();
+                        return !m_pEnvironment->m_application.IsEmpty();
                     }
                 }
             }
             return false;
 		}
 
+        bool Interface::createSnapshot(const EngineParameters& params, const char* path)
+        {
+            return Environment::createSnapshot(params, path);
+        }
+
         void Interface::load()
         {
             v8::Isolate* pIsolate = m_pEnvironment->m_pIsolate;
             v8::HandleScope scope(pIsolate);
             v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-            v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-            v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "load")).ToLocalChecked();
+            v8::Local<v8::Object> application = m_pEnvironment->m_application.Get(pIsolate);
             m_pEnvironment->m_pRenderer = m_pEnvironment->m_engine.getRenderer();
             v8::Local<v8::Object> value = m_pEnvironment->m_elemTemplate.Get(pIsolate)->NewInstance(context).ToLocalChecked();
-            value->SetInternalField(0, v8::External::New(pIsolate, m_pEnvironment->m_pRenderer->getStage() ));
+            binding::wrap<IRenderElement>(value, m_pEnvironment->m_pRenderer->getStage());
+            value->SetInternalField(1, v8::Integer::NewFromUnsigned(pIsolate, m_pEnvironment->m_commands.add(m_pEnvironment->m_pRenderer->getStage())));
             v8::Local<v8::Value> args[] = { value };
-            v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 1, args);
+            if (!m_pEnvironment->m_load.IsEmpty())
+                m_pEnvironment->m_load.Get(pIsolate)->Call(context, application, 1, args);
+            m_pEnvironment->runMicrotasks(Environment::Checkpoint::LOAD);
         }
 
         bool Interface::update(float delta)
         {
+            FLINT_TRACE_SCOPE("Interface::update");
             v8::Isolate* pIsolate = m_pEnvironment->m_pIsolate;
             v8::HandleScope scope(pIsolate);
+            m_pEnvironment->m_gcPhase = Environment::GCPhase::FRAME;
+            m_pEnvironment->resetMicrotaskBudget();
+            m_pEnvironment->processImports();
+            m_pEnvironment->processFileRequests();
+            m_pEnvironment->dispatchWorkerMessages();
             v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-            v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-            v8::Local<v8::Function> onProcess = m_pEnvironment->ProcessFunc.Get(pIsolate);
+            v8::Local<v8::Object> application = m_pEnvironment->m_application.Get(pIsolate);
+            v8::Local<v8::Function> onProcess = m_pEnvironment->m_update.Get(pIsolate);
             v8::Local<v8::Value> args[] = { v8::Number::New(pIsolate, delta) };
-            onProcess->Call(context, application, 1, args);
-            return true;
+            v8::Local<v8::Value> result;
+            // Application.update tells whether update callbacks are set,
+            // which keep frames coming like pending animation frames.
+            m_pEnvironment->m_bContinuous = onProcess->Call(context, application, 1, args).ToLocal(&result) && result->BooleanValue(pIsolate);
+            m_pEnvironment->runTimers();
+            m_pEnvironment->runMicrotasks(Environment::Checkpoint::TIMERS);
+            m_pEnvironment->executeCommands();
+            m_pEnvironment->collectElements();
+            m_pEnvironment->m_gcPhase = Environment::GCPhase::OTHER;
+            return isAnimating();
+        }
+
+        void Interface::animate(double timestamp)
+        {
+            m_pEnvironment->m_gcPhase = Environment::GCPhase::FRAME;
+            m_pEnvironment->runFrameCallbacks(timestamp);
+            m_pEnvironment->runMicrotasks(Environment::Checkpoint::LAYOUT);
+            m_pEnvironment->executeCommands();
+            m_pEnvironment->m_gcPhase = Environment::GCPhase::OTHER;
+        }
+
+        bool Interface::idle(double budget, bool bUntilInput)
+        {
+            return m_pEnvironment->idle(budget, bUntilInput);
+        }
+
+        const GCStats& Interface::getGCStats() const
+        {
+            return m_pEnvironment->m_gcStats;
+        }
+
+        void Interface::mark(FramePhase phase)
+        {
+            m_pEnvironment->m_pProfiler->mark(phase);
+        }
+
+        bool Interface::isAnimating() const
+        {
+            return m_pEnvironment->m_bContinuous || !m_pEnvironment->m_vecFrameCallbacks.empty() || m_pEnvironment->isImporting() || m_pEnvironment->m_bMicrotasksDeferred;
+        }
+
+        double Interface::getTimeout() const
+        {
+            return m_pEnvironment->getTimeout();
         }
 
         bool Interface::beforeUnload()
@@ -591,8 +2471,8 @@ namespace flint
             v8::Isolate* pIsolate = m_pEnvironment->m_pIsolate;
             v8::HandleScope scope(pIsolate);
             v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-            v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-            v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "onbeforeunload")).ToLocalChecked();
+            v8::Local<v8::Object> application = m_pEnvironment->m_application.Get(pIsolate);
+            v8::Local<v8::Value> callback = application->Get(context, binding::getString(pIsolate, binding::Name::ON_BEFORE_UNLOAD)).ToLocalChecked();
             if (callback->IsFunction())
             {
                 v8::MaybeLocal<v8::Value> retVal = v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 0, nullptr);
@@ -607,8 +2487,8 @@ namespace flint
             v8::Isolate* pIsolate = m_pEnvironment->m_pIsolate;
             v8::HandleScope scope(pIsolate);
             v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-            v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-            v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "onunload")).ToLocalChecked();
+            v8::Local<v8::Object> application = m_pEnvironment->m_application.Get(pIsolate);
+            v8::Local<v8::Value> callback = application->Get(context, binding::getString(pIsolate, binding::Name::ON_UNLOAD)).ToLocalChecked();
             if (callback->IsFunction())
                 v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 0, nullptr);
         }
@@ -618,10 +2498,14 @@ namespace flint
             v8::Isolate* pIsolate = m_pEnvironment->m_pIsolate;
             v8::HandleScope scope(pIsolate);
             v8::Local<v8::Context> context = m_pEnvironment->m_context.Get(pIsolate);
-            v8::Local<v8::Object> application = m_pEnvironment->Application.Get(pIsolate);
-            v8::Local<v8::Value> callback = application->Get(context, v8::String::NewFromUtf8Literal(pIsolate, "fireEvent")).ToLocalChecked();
+            v8::Local<v8::Object> application = m_pEnvironment->m_application.Get(pIsolate);
+            if (m_pEnvironment->m_fireEvent.IsEmpty())
+                return false;
             v8::Local<v8::Value> args[4] = { v8::Integer::New(pIsolate, type), v8::Integer::New(pIsolate, a), v8::String::NewFromTwoByte(pIsolate, (const uint16_t*)b).ToLocalChecked(), v8::Integer::New(pIsolate, c) };
-            return v8::Handle<v8::Function>::Cast(callback)->Call(context, application, 4, args).ToLocalChecked()->BooleanValue(pIsolate);
+            v8::Local<v8::Value> result;
+            const bool bHandled = m_pEnvironment->m_fireEvent.Get(pIsolate)->Call(context, application, 4, args).ToLocal(&result) && result->BooleanValue(pIsolate);
+            m_pEnvironment->runMicrotasks(Environment::Checkpoint::INPUT);
+            return bHandled;
         }
      
 	}
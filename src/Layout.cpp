@@ -0,0 +1,233 @@
+#include "Layout.hpp"
+#include "RenderElement.hpp"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+namespace flint
+{
+	namespace
+	{
+		struct Item
+		{
+			IRenderElement* pElement;
+			float base;
+			float main;
+			float cross;
+			float crossPos;
+		};
+
+		inline float getMain(const Size& size, bool bRow) { return bRow ? size.width : size.height; }
+		inline float getCross(const Size& size, bool bRow) { return bRow ? size.height : size.width; }
+
+		// Scratch buffer reused across containers so relayout doesn't allocate.
+		thread_local std::vector<Item> Items;
+	}
+
+	Size FlexLayout::measure(IRenderElement& element)
+	{
+		FlexStyle* pStyle = element.m_pFlex;
+		if (pStyle == nullptr)
+			return element.m_rect.size;
+		if (!pStyle->isAutoSized())
+			return pStyle->size;
+		if (!pStyle->bMeasured)
+		{
+			float main = 0, cross = 0;
+			if (pStyle->isContainer())
+			{
+				const bool bRow = pStyle->isRow();
+				size_t count = 0;
+				for (size_t i = 0; i < element.m_vecChildren.size(); ++i)
+				{
+					IRenderElement* pChild = element.m_vecChildren[i];
+					if (!pChild->m_bVisible)
+						continue;
+					const Size size = measure(*pChild);
+					const int32_t basis = pChild->m_pFlex ? pChild->m_pFlex->basis : -1;
+					main += (basis >= 0) ? basis : getMain(size, bRow);
+					cross = std::max(cross, getCross(size, bRow));
+					++count;
+				}
+				if (count > 1)
+					main += (count - 1) * pStyle->gap;
+				const uint16_t* padding = pStyle->padding;
+				const Size content = bRow ? Size((Size::Type)main, (Size::Type)cross) : Size((Size::Type)cross, (Size::Type)main);
+				pStyle->measured = Size(content.width + padding[1] + padding[3], content.height + padding[0] + padding[2]);
+			}
+			else
+				pStyle->measured = Size();
+			pStyle->bMeasured = true;
+		}
+		return Size(pStyle->size.width ? pStyle->size.width : pStyle->measured.width,
+					pStyle->size.height ? pStyle->size.height : pStyle->measured.height);
+	}
+
+	void FlexLayout::arrange(IRenderElement& container)
+	{
+		const FlexStyle& style = *container.m_pFlex;
+		const bool bRow = style.isRow();
+		const bool bReverse = style.isReverse();
+		const uint16_t* padding = style.padding;
+		const Size& size = container.m_rect.size;
+		const float innerMain = std::max(0.0f, bRow ? (float)size.width - padding[1] - padding[3] : (float)size.height - padding[0] - padding[2]);
+		const float innerCross = std::max(0.0f, bRow ? (float)size.height - padding[0] - padding[2] : (float)size.width - padding[1] - padding[3]);
+		const float startMain = bRow ? padding[3] : padding[0];
+		const float startCross = bRow ? padding[0] : padding[3];
+		const float gap = style.gap;
+
+		std::vector<Item>& items = Items;
+		items.clear();
+		for (size_t i = 0; i < container.m_vecChildren.size(); ++i)
+		{
+			IRenderElement* pChild = container.m_vecChildren[i];
+			if (!pChild->m_bVisible)
+				continue;
+			const Size preferred = measure(*pChild);
+			const int32_t basis = pChild->m_pFlex ? pChild->m_pFlex->basis : -1;
+			const float base = (basis >= 0) ? (float)basis : getMain(preferred, bRow);
+			items.push_back({ pChild, base, base, getCross(preferred, bRow), 0 });
+		}
+
+		float crossOffset = 0;
+		size_t begin = 0;
+		while (begin < items.size())
+		{
+			size_t end = begin + 1;
+			float used = items[begin].base;
+			if (style.bWrap)
+			{
+				for (; end < items.size() && used + gap + items[end].base <= innerMain; ++end)
+					used += gap + items[end].base;
+			}
+			else
+			{
+				for (; end < items.size(); ++end)
+					used += gap + items[end].base;
+			}
+
+			float free = innerMain - used;
+			float totalGrow = 0, totalShrink = 0;
+			for (size_t i = begin; i < end; ++i)
+			{
+				const FlexStyle* pItem = items[i].pElement->m_pFlex;
+				if (pItem)
+				{
+					totalGrow += pItem->grow;
+					totalShrink += pItem->shrink * items[i].base;
+				}
+			}
+			if (free > 0 && totalGrow > 0)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					const FlexStyle* pItem = items[i].pElement->m_pFlex;
+					if (pItem)
+						items[i].main += free * pItem->grow / totalGrow;
+				}
+				free = 0;
+			}
+			else if (free < 0 && totalShrink > 0)
+			{
+				float shrunk = 0;
+				for (size_t i = begin; i < end; ++i)
+				{
+					const FlexStyle* pItem = items[i].pElement->m_pFlex;
+					if (pItem)
+					{
+						const float main = std::max(0.0f, items[i].base + free * pItem->shrink * items[i].base / totalShrink);
+						shrunk += items[i].base - main;
+						items[i].main = main;
+					}
+				}
+				free = std::min(0.0f, free + shrunk);
+			}
+
+			float lineCross = 0;
+			if (!style.bWrap)
+				lineCross = innerCross;
+			else
+			{
+				for (size_t i = begin; i < end; ++i)
+					lineCross = std::max(lineCross, items[i].cross);
+			}
+			for (size_t i = begin; i < end; ++i)
+			{
+				Item& item = items[i];
+				const FlexStyle* pItem = item.pElement->m_pFlex;
+				FlexStyle::Align align = (pItem && pItem->alignSelf != FlexStyle::Align::AUTO) ? pItem->alignSelf : style.alignItems;
+				const bool bAutoCross = pItem && (bRow ? pItem->size.height == 0 : pItem->size.width == 0);
+				if (align == FlexStyle::Align::STRETCH && bAutoCross)
+					item.cross = lineCross;
+				switch (align)
+				{
+				case FlexStyle::Align::END:
+					item.crossPos = lineCross - item.cross;
+					break;
+				case FlexStyle::Align::CENTER:
+					item.crossPos = 0.5f * (lineCross - item.cross);
+					break;
+				default:
+					item.crossPos = 0;
+					break;
+				}
+			}
+
+			const size_t count = end - begin;
+			const float space = std::max(0.0f, free);
+			float offset = 0, spacing = gap;
+			switch (style.justify)
+			{
+			case FlexStyle::Justify::END:
+				offset = free;
+				break;
+			case FlexStyle::Justify::CENTER:
+				offset = 0.5f * free;
+				break;
+			case FlexStyle::Justify::SPACE_BETWEEN:
+				if (count > 1)
+					spacing += space / (count - 1);
+				break;
+			case FlexStyle::Justify::SPACE_AROUND:
+				offset = 0.5f * space / count;
+				spacing += space / count;
+				break;
+			case FlexStyle::Justify::SPACE_EVENLY:
+				offset = space / (count + 1);
+				spacing += space / (count + 1);
+				break;
+			default:
+				break;
+			}
+
+			float mainPos = offset;
+			for (size_t i = begin; i < end; ++i)
+			{
+				Item& item = items[i];
+				const float main0 = bReverse ? innerMain - mainPos - item.main : mainPos;
+				const float cross0 = crossOffset + item.crossPos;
+				const int32_t m0 = (int32_t)std::lround(startMain + main0);
+				const int32_t m1 = (int32_t)std::lround(startMain + main0 + item.main);
+				const int32_t c0 = (int32_t)std::lround(startCross + cross0);
+				const int32_t c1 = (int32_t)std::lround(startCross + cross0 + item.cross);
+				const Size itemSize = bRow ? Size((Size::Type)std::max(0, m1 - m0), (Size::Type)std::max(0, c1 - c0)) : Size((Size::Type)std::max(0, c1 - c0), (Size::Type)std::max(0, m1 - m0));
+				IRenderElement* pChild = item.pElement;
+				pChild->setPosition(bRow ? Position(m0, c0) : Position(c0, m0));
+				if (pChild->m_rect.size != itemSize)
+				{
+					pChild->resize(itemSize);
+					if (pChild->isFlexContainer())
+					{
+						pChild->m_bInvalidLayout = true;
+						container.m_bChildLayoutDirty = true;
+					}
+				}
+				mainPos += item.main + spacing;
+			}
+
+			crossOffset += lineCross + gap;
+			begin = end;
+		}
+	}
+
+}
@@ -11,8 +11,9 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR  lpCmdLine, int
 	params.commandLine = lpCmdLine;
 	params.main = L"Scripts\\main.js";
 	flint::Engine* pEngine = flint::Engine::Create(params);
+	int result = 1;
 	if (pEngine->initialize())
-		pEngine->run();
+		result = pEngine->run();
 	pEngine->release();
-	return 0;
+	return result;
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "Memory.hpp"
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+
+namespace flint
+{
+	namespace memory
+	{
+		static const size_t SLAB_SIZE = 16 * 1024;
+		static const size_t MIN_BLOCKS_PER_SLAB = 8;
+
+		Pool::Pool(size_t blockSize) : m_pFree(nullptr),
+									   m_nBlocksPerSlab(std::max<size_t>(SLAB_SIZE / blockSize, MIN_BLOCKS_PER_SLAB)),
+									   m_stats({ blockSize, 0, 0, 0 })
+		{
+			assert(blockSize >= sizeof(Block));
+		}
+
+		Pool::~Pool()
+		{
+			for (size_t i = 0; i < m_vecSlabs.size(); ++i)
+				free(m_vecSlabs[i]);
+		}
+
+		void Pool::grow()
+		{
+			char* pSlab = (char*)malloc(m_nBlocksPerSlab * m_stats.blockSize);
+			if (pSlab == nullptr)
+				throw std::bad_alloc();
+			m_vecSlabs.push_back(pSlab);
+			for (size_t i = m_nBlocksPerSlab; i > 0; --i)
+			{
+				Block* pBlock = (Block*)(pSlab + (i - 1) * m_stats.blockSize);
+				pBlock->pNext = m_pFree;
+				m_pFree = pBlock;
+			}
+			m_stats.free += m_nBlocksPerSlab;
+		}
+
+		void* Pool::allocate()
+		{
+			if (m_pFree == nullptr)
+				grow();
+			Block* pBlock = m_pFree;
+			m_pFree = pBlock->pNext;
+			--m_stats.free;
+			if (++m_stats.live > m_stats.peak)
+				m_stats.peak = m_stats.live;
+			return pBlock;
+		}
+
+		void Pool::deallocate(void* p)
+		{
+			Block* pBlock = (Block*)p;
+			pBlock->pNext = m_pFree;
+			m_pFree = pBlock;
+			--m_stats.live;
+			++m_stats.free;
+		}
+
+		size_t Pool::trim()
+		{
+			if (m_stats.free < m_nBlocksPerSlab)
+				return 0;
+			const size_t slabSize = m_nBlocksPerSlab * m_stats.blockSize;
+			std::sort(m_vecSlabs.begin(), m_vecSlabs.end());
+			auto getSlab = [this](Block* pBlock)
+			{
+				return std::upper_bound(m_vecSlabs.begin(), m_vecSlabs.end(), (void*)pBlock, std::less<void*>()) - m_vecSlabs.begin() - 1;
+			};
+			std::vector<size_t> vecFree(m_vecSlabs.size(), 0);
+			for (Block* pBlock = m_pFree; pBlock; pBlock = pBlock->pNext)
+				++vecFree[getSlab(pBlock)];
+			// Free blocks of the slabs that stay are linked again.
+			Block* pFree = nullptr;
+			for (Block* pBlock = m_pFree; pBlock;)
+			{
+				Block* pNext = pBlock->pNext;
+				if (vecFree[getSlab(pBlock)] != m_nBlocksPerSlab)
+				{
+					pBlock->pNext = pFree;
+					pFree = pBlock;
+				}
+				pBlock = pNext;
+			}
+			m_pFree = pFree;
+			size_t nKept = 0;
+			for (size_t i = 0; i < m_vecSlabs.size(); ++i)
+			{
+				if (vecFree[i] == m_nBlocksPerSlab)
+					free(m_vecSlabs[i]);
+				else
+					m_vecSlabs[nKept++] = m_vecSlabs[i];
+			}
+			const size_t nReleased = m_vecSlabs.size() - nKept;
+			m_vecSlabs.resize(nKept);
+			m_stats.free -= nReleased * m_nBlocksPerSlab;
+			return nReleased * slabSize;
+		}
+
+		struct Pools
+		{
+			Pools()
+			{
+				for (size_t i = 0; i < POOL_COUNT; ++i)
+					pools[i] = nullptr;
+			}
+
+			~Pools()
+			{
+				for (size_t i = 0; i < POOL_COUNT; ++i)
+					delete pools[i];
+			}
+
+			Pool& get(size_t index)
+			{
+				if (pools[index] == nullptr)
+					pools[index] = new Pool((index + 1) * GRANULARITY);
+				return *pools[index];
+			}
+
+			Pool* pools[POOL_COUNT];
+		};
+
+		static Pools& getPools()
+		{
+			static Pools pools;
+			return pools;
+		}
+
+		static inline size_t getSizeClass(size_t size)
+		{
+			return (size == 0) ? 0 : (size - 1) / GRANULARITY;
+		}
+
+		void* allocate(size_t size)
+		{
+			if (size > MAX_POOLED_SIZE)
+				return ::operator new(size);
+			return getPools().get(getSizeClass(size)).allocate();
+		}
+
+		void deallocate(void* p, size_t size)
+		{
+			if (p == nullptr)
+				return;
+			if (size > MAX_POOLED_SIZE)
+				::operator delete(p);
+			else
+				getPools().get(getSizeClass(size)).deallocate(p);
+		}
+
+		size_t trim()
+		{
+			size_t released = 0;
+			Pools& pools = getPools();
+			for (size_t i = 0; i < POOL_COUNT; ++i)
+			{
+				if (pools.pools[i])
+					released += pools.pools[i]->trim();
+			}
+			return released;
+		}
+
+		const PoolStats& getStats(size_t index)
+		{
+			assert(index < POOL_COUNT);
+			static PoolStats empty[POOL_COUNT];
+			const Pool* pPool = getPools().pools[index];
+			if (pPool)
+				return pPool->getStats();
+			empty[index].blockSize = (index + 1) * GRANULARITY;
+			return empty[index];
+		}
+	}
+}
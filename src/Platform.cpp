@@ -3,13 +3,17 @@
 #include <windows.h>
 #include <windowsx.h>
 #include <Shlwapi.h>
+#include <Psapi.h>
 #include <io.h>
 #include <gl/gl.h>
 #include <fcntl.h>
 #include <chrono>
+#include <cstdlib>
+#include <cwchar>
 #include <iostream>
 
 #pragma comment (lib, "shlwapi.lib")
+#pragma comment (lib, "psapi.lib")
 
 namespace flint
 {
@@ -31,6 +35,7 @@ namespace flint
 		static const wchar_t* KeyNames[256] = { 0 };
 		static IEngineEventListener* EventListener = nullptr;
 		static int widthOffset = 0, heightOffset = 0;
+		static DWORD MainThreadId = 0;
 
 		struct _KeyNameMap
 		{
@@ -278,6 +283,7 @@ namespace flint
 		{
 			bool bDone = false;
 			MSG msg;
+			MainThreadId = GetCurrentThreadId();
 			while (!bDone)
 			{
 				if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
@@ -344,11 +350,30 @@ namespace flint
 			Sleep(ms);
 		}
 
+		void waitForEvents(int ms)
+		{
+			MsgWaitForMultipleObjectsEx(0, NULL, (ms < 0) ? INFINITE : (DWORD)ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+		}
+
+		void wake()
+		{
+			if (MainThreadId)
+				PostThreadMessage(MainThreadId, WM_NULL, 0, 0);
+		}
+
+		int getRefreshRate(Window* pWindow)
+		{
+			const int rate = GetDeviceCaps(pWindow->hDC, VREFRESH);
+			return (rate > 1) ? rate : 0;
+		}
+
 		void createConsole(const wchar_t* title)
 		{
 			FILE* fp = nullptr;
 			AllocConsole();
 			SetConsoleTitle(title);
+			// Script output is written as UTF-8.
+			SetConsoleOutputCP(CP_UTF8);
 			if(GetStdHandle(STD_OUTPUT_HANDLE))
 				freopen_s(&fp, "CONOUT$", "w", stdout);
 			if(GetStdHandle(STD_ERROR_HANDLE))
@@ -369,6 +394,134 @@ namespace flint
 			FreeConsole();
 		}
 
+		size_t getPeakMemoryUsage()
+		{
+			PROCESS_MEMORY_COUNTERS counters;
+			if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+				return counters.PeakWorkingSetSize;
+			return 0;
+		}
+
+		namespace
+		{
+			struct FileMapping : public MappedFile
+			{
+				HANDLE hFile;
+				HANDLE hMapping;
+			};
+		}
+
+		// Other processes may still read the file, or replace it by renaming
+		// as editors do, while it is mapped.
+		MappedFile* mapFile(const wchar_t* path)
+		{
+			HANDLE hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return nullptr;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(hFile, &size))
+			{
+				CloseHandle(hFile);
+				return nullptr;
+			}
+			FileMapping* pFile = new FileMapping();
+			pFile->hFile = hFile;
+			pFile->hMapping = NULL;
+			pFile->data = "";
+			pFile->size = 0;
+			// Empty files can't be mapped.
+			if (size.QuadPart > 0)
+			{
+				pFile->hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+				const void* pView = pFile->hMapping ? MapViewOfFile(pFile->hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+				if (pView == NULL)
+				{
+					unmapFile(pFile);
+					return nullptr;
+				}
+				pFile->data = reinterpret_cast<const char*>(pView);
+				pFile->size = (size_t)size.QuadPart;
+			}
+			return pFile;
+		}
+
+		void unmapFile(MappedFile* pFile)
+		{
+			FileMapping* pMapping = static_cast<FileMapping*>(pFile);
+			if (pMapping == nullptr)
+				return;
+			if (pMapping->size)
+				UnmapViewOfFile(pMapping->data);
+			if (pMapping->hMapping)
+				CloseHandle(pMapping->hMapping);
+			CloseHandle(pMapping->hFile);
+			delete pMapping;
+		}
+
+		char* readFile(const wchar_t* path, size_t& size)
+		{
+			HANDLE hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return nullptr;
+			LARGE_INTEGER fileSize;
+			char* pData = nullptr;
+			if (GetFileSizeEx(hFile, &fileSize) && (uint64_t)fileSize.QuadPart < SIZE_MAX)
+			{
+				size = (size_t)fileSize.QuadPart;
+				pData = (char*)malloc(size ? size : 1);
+				// ReadFile takes 32 bit sizes.
+				for (size_t offset = 0; pData && offset < size;)
+				{
+					const size_t remaining = size - offset;
+					DWORD nRead = 0;
+					if (!ReadFile(hFile, pData + offset, (remaining > (1u << 30)) ? (1u << 30) : (DWORD)remaining, &nRead, NULL) || nRead == 0)
+					{
+						free(pData);
+						pData = nullptr;
+					}
+					offset += nRead;
+				}
+			}
+			CloseHandle(hFile);
+			return pData;
+		}
+
+		bool getFileInfo(const wchar_t* path, FileInfo& info)
+		{
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data))
+				return false;
+			// File times count 100 ns intervals since 1601.
+			const uint64_t modified = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+			info.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+			info.modified = (double)(modified - 116444736000000000ull) / 10000.0;
+			info.bDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+			return true;
+		}
+
+		bool listDirectory(const wchar_t* path, std::vector<DirectoryEntry>& vecEntries)
+		{
+			std::wstring pattern(path);
+			if (!pattern.empty() && pattern.back() != L'\\' && pattern.back() != L'/')
+				pattern += L'\\';
+			pattern += L'*';
+			WIN32_FIND_DATAW data;
+			HANDLE hFind = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+			if (hFind == INVALID_HANDLE_VALUE)
+				return false;
+			do
+			{
+				if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0)
+					continue;
+				DirectoryEntry entry;
+				entry.name = data.cFileName;
+				entry.bDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+				vecEntries.push_back(std::move(entry));
+			} while (FindNextFileW(hFind, &data));
+			FindClose(hFind);
+			return true;
+		}
+
 		std::wstring getCWD()
 		{
 			std::wstring result;
@@ -391,10 +544,33 @@ namespace flint
 			return buffer;
 		}
 
+		std::wstring resolvePath(const wchar_t* directory, const wchar_t* path)
+		{
+			std::wstring combined(path);
+			if (PathIsRelative(path))
+				combined = std::wstring(directory) + L"\\" + path;
+			const DWORD length = GetFullPathName(combined.c_str(), 0, NULL, NULL);
+			if (length == 0)
+				return combined;
+			std::wstring result(length, L'\0');
+			result.resize(GetFullPathName(combined.c_str(), length, &result[0], NULL));
+			return result;
+		}
+
 		std::wstring getFileName(const wchar_t* path)
 		{
 			return PathFindFileName(path);
 		}
+
+		std::string resolveExecutablePath(const char* path)
+		{
+			char buffer[MAX_PATH];
+			const DWORD length = GetModuleFileNameA(NULL, buffer, MAX_PATH);
+			if (!PathIsRelativeA(path) || length == 0 || length == MAX_PATH)
+				return path;
+			PathRemoveFileSpecA(buffer);
+			return std::string(buffer) + "\\" + path;
+		}
 	}
 
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "Profiler.hpp"
+#include "libplatform/libplatform.h"
+#include "Trace.hpp"
+#include <cstdio>
+#include <memory>
+
+namespace flint
+{
+	namespace javascript
+	{
+		namespace
+		{
+			const char* const PROFILE_TITLE = "flint";
+
+			const char* getPhaseName(FramePhase phase)
+			{
+				switch (phase)
+				{
+				case FramePhase::SCRIPT:
+					return "script";
+				case FramePhase::RENDER:
+					return "render";
+				default:
+					return "idle";
+				}
+			}
+
+			void writeString(FILE* file, const char* str)
+			{
+				fputc('"', file);
+				for (; str && *str; ++str)
+				{
+					const unsigned char ch = (unsigned char)*str;
+					if (ch == '"' || ch == '\\')
+						fprintf(file, "\\%c", ch);
+					else if (ch < 0x20)
+						fprintf(file, "\\u%04x", ch);
+					else
+						fputc(ch, file);
+				}
+				fputc('"', file);
+			}
+
+			// DevTools call frames have 0-based lines and columns, V8
+			// reports them 1-based or 0 when unknown.
+			void writeCallFrame(FILE* file, const char* name, int scriptId, const char* url, int line, int column)
+			{
+				fputs("\"callFrame\":{\"functionName\":", file);
+				writeString(file, name);
+				fprintf(file, ",\"scriptId\":\"%d\",\"url\":", scriptId);
+				writeString(file, url);
+				fprintf(file, ",\"lineNumber\":%d,\"columnNumber\":%d}", line - 1, column - 1);
+			}
+
+			class FileStream : public v8::OutputStream
+			{
+			public:
+
+				explicit FileStream(FILE* file) : m_file(file) {}
+
+				int GetChunkSize() override { return 64 * 1024; }
+				void EndOfStream() override {}
+
+				WriteResult WriteAsciiChunk(char* data, int size) override
+				{
+					return (fwrite(data, 1, (size_t)size, m_file) == (size_t)size) ? kContinue : kAbort;
+				}
+
+			private:
+
+				FILE* m_file;
+			};
+		}
+
+		Profiler::Profiler(v8::Isolate* pIsolate, v8::Platform* pPlatform) : m_pIsolate(pIsolate),
+																			 m_pPlatform(pPlatform),
+																			 m_pCpuProfiler(nullptr),
+																			 m_nFrame(0),
+																			 m_bIdle(false)
+		{
+		}
+
+		Profiler::~Profiler()
+		{
+			stop();
+			if (m_pCpuProfiler)
+				m_pCpuProfiler->Dispose();
+		}
+
+		bool Profiler::startCpu(const std::string& path)
+		{
+			if (isCpuProfiling() || path.empty())
+				return false;
+			v8::HandleScope scope(m_pIsolate);
+			if (m_pCpuProfiler == nullptr)
+				m_pCpuProfiler = v8::CpuProfiler::New(m_pIsolate);
+			if (m_pCpuProfiler->StartProfiling(v8::String::NewFromUtf8(m_pIsolate, PROFILE_TITLE).ToLocalChecked(), v8::CpuProfilingOptions()) != v8::CpuProfilingStatus::kStarted)
+				return false;
+			m_cpuPath = path;
+			m_vecMarkers.clear();
+			m_nFrame = 0;
+			return true;
+		}
+
+		bool Profiler::startHeapSampling(const std::string& path)
+		{
+			if (isHeapSampling() || path.empty() || !m_pIsolate->GetHeapProfiler()->StartSamplingHeapProfiler())
+				return false;
+			m_heapPath = path;
+			return true;
+		}
+
+		bool Profiler::stop()
+		{
+			FLINT_TRACE_SCOPE("Profiler::stop");
+			v8::HandleScope scope(m_pIsolate);
+			bool bWritten = true;
+			if (isCpuProfiling())
+			{
+				if (m_bIdle)
+				{
+					m_pIsolate->SetIdle(false);
+					m_bIdle = false;
+				}
+				v8::CpuProfile* pProfile = m_pCpuProfiler->StopProfiling(v8::String::NewFromUtf8(m_pIsolate, PROFILE_TITLE).ToLocalChecked());
+				if (pProfile)
+				{
+					bWritten = writeCpuProfile(pProfile) && bWritten;
+					pProfile->Delete();
+				}
+				m_cpuPath.clear();
+				m_vecMarkers.clear();
+			}
+			if (isHeapSampling())
+			{
+				v8::HeapProfiler* pHeapProfiler = m_pIsolate->GetHeapProfiler();
+				std::unique_ptr<v8::AllocationProfile> pProfile(pHeapProfiler->GetAllocationProfile());
+				pHeapProfiler->StopSamplingHeapProfiler();
+				if (pProfile)
+					bWritten = writeHeapProfile(pProfile.get()) && bWritten;
+				m_heapPath.clear();
+			}
+			return bWritten;
+		}
+
+		void Profiler::mark(FramePhase phase)
+		{
+			if (!isCpuProfiling())
+				return;
+			if (phase == FramePhase::SCRIPT)
+				++m_nFrame;
+			const bool bIdle = phase == FramePhase::IDLE;
+			if (bIdle != m_bIdle)
+			{
+				m_pIsolate->SetIdle(bIdle);
+				m_bIdle = bIdle;
+			}
+			const Marker marker = { (int64_t)(m_pPlatform->MonotonicallyIncreasingTime() * 1000000.0), m_nFrame, phase };
+			m_vecMarkers.push_back(marker);
+			v8::CpuProfiler::CollectSample(m_pIsolate);
+		}
+
+		bool Profiler::writeCpuProfile(const v8::CpuProfile* pProfile)
+		{
+			FILE* file = fopen(m_cpuPath.c_str(), "wb");
+			if (file == nullptr)
+			{
+				printf("Unable to write CPU profile %s\n", m_cpuPath.c_str());
+				return false;
+			}
+			fputs("{\"nodes\":[", file);
+			std::vector<const v8::CpuProfileNode*> vecStack(1, pProfile->GetTopDownRoot());
+			bool bFirst = true;
+			while (!vecStack.empty())
+			{
+				const v8::CpuProfileNode* pNode = vecStack.back();
+				vecStack.pop_back();
+				fprintf(file, "%s\n{\"id\":%u,", bFirst ? "" : ",", pNode->GetNodeId());
+				writeCallFrame(file, pNode->GetFunctionNameStr(), pNode->GetScriptId(), pNode->GetScriptResourceNameStr(), pNode->GetLineNumber(), pNode->GetColumnNumber());
+				fprintf(file, ",\"hitCount\":%u,\"children\":[", pNode->GetHitCount());
+				for (int i = 0; i < pNode->GetChildrenCount(); ++i)
+				{
+					const v8::CpuProfileNode* pChild = pNode->GetChild(i);
+					fprintf(file, "%s%u", i ? "," : "", pChild->GetNodeId());
+					vecStack.push_back(pChild);
+				}
+				fputs("]}", file);
+				bFirst = false;
+			}
+			fprintf(file, "],\n\"startTime\":%lld,\"endTime\":%lld,\n\"samples\":[", (long long)pProfile->GetStartTime(), (long long)pProfile->GetEndTime());
+			const int count = pProfile->GetSamplesCount();
+			for (int i = 0; i < count; ++i)
+				fprintf(file, "%s%u", i ? "," : "", pProfile->GetSample(i)->GetNodeId());
+			fputs("],\n\"timeDeltas\":[", file);
+			int64_t last = pProfile->GetStartTime();
+			for (int i = 0; i < count; ++i)
+			{
+				const int64_t time = pProfile->GetSampleTimestamp(i);
+				fprintf(file, "%s%lld", i ? "," : "", (long long)(time - last));
+				last = time;
+			}
+			// Ignored by the DevTools, for tools relating samples to frames.
+			fputs("],\n\"frames\":[", file);
+			for (size_t i = 0; i < m_vecMarkers.size(); ++i)
+			{
+				const Marker& marker = m_vecMarkers[i];
+				fprintf(file, "%s\n{\"frame\":%u,\"phase\":\"%s\",\"time\":%lld}", i ? "," : "", marker.frame, getPhaseName(marker.phase), (long long)marker.time);
+			}
+			fputs("]}\n", file);
+			fclose(file);
+			return true;
+		}
+
+		bool Profiler::writeHeapProfile(v8::AllocationProfile* pProfile)
+		{
+			FILE* file = fopen(m_heapPath.c_str(), "wb");
+			if (file == nullptr)
+			{
+				printf("Unable to write heap profile %s\n", m_heapPath.c_str());
+				return false;
+			}
+			// The DevTools expect the call tree nested.
+			struct Frame
+			{
+				v8::AllocationProfile::Node* pNode;
+				size_t child;
+			};
+			std::vector<Frame> vecStack;
+			vecStack.push_back({ pProfile->GetRootNode(), 0 });
+			fputs("{\"head\":", file);
+			while (!vecStack.empty())
+			{
+				Frame& frame = vecStack.back();
+				v8::AllocationProfile::Node* pNode = frame.pNode;
+				if (frame.child == 0)
+				{
+					v8::String::Utf8Value name(m_pIsolate, pNode->name);
+					v8::String::Utf8Value url(m_pIsolate, pNode->script_name);
+					size_t selfSize = 0;
+					for (size_t i = 0; i < pNode->allocations.size(); ++i)
+						selfSize += pNode->allocations[i].size * pNode->allocations[i].count;
+					fputc('{', file);
+					writeCallFrame(file, (vecStack.size() == 1) ? "(root)" : *name, pNode->script_id, *url, pNode->line_number, pNode->column_number);
+					fprintf(file, ",\"selfSize\":%zu,\"id\":%u,\"children\":[", selfSize, pNode->node_id);
+				}
+				if (frame.child < pNode->children.size())
+				{
+					if (frame.child)
+						fputc(',', file);
+					v8::AllocationProfile::Node* pChild = pNode->children[frame.child++];
+					vecStack.push_back({ pChild, 0 });
+				}
+				else
+				{
+					fputs("]}", file);
+					vecStack.pop_back();
+				}
+			}
+			fputs(",\n\"samples\":[", file);
+			const std::vector<v8::AllocationProfile::Sample>& vecSamples = pProfile->GetSamples();
+			for (size_t i = 0; i < vecSamples.size(); ++i)
+			{
+				const v8::AllocationProfile::Sample& sample = vecSamples[i];
+				fprintf(file, "%s\n{\"size\":%zu,\"nodeId\":%u,\"ordinal\":%llu}", i ? "," : "", sample.size * sample.count, sample.node_id, (unsigned long long)sample.sample_id);
+			}
+			fputs("]}\n", file);
+			fclose(file);
+			return true;
+		}
+
+		bool Profiler::writeHeapSnapshot(v8::Isolate* pIsolate, const std::string& path)
+		{
+			FLINT_TRACE_SCOPE("Profiler::writeHeapSnapshot");
+			FILE* file = path.empty() ? nullptr : fopen(path.c_str(), "wb");
+			if (file == nullptr)
+			{
+				printf("Unable to write heap snapshot %s\n", path.c_str());
+				return false;
+			}
+			const v8::HeapSnapshot* pSnapshot = pIsolate->GetHeapProfiler()->TakeHeapSnapshot();
+			FileStream stream(file);
+			pSnapshot->Serialize(&stream, v8::HeapSnapshot::kJSON);
+			const_cast<v8::HeapSnapshot*>(pSnapshot)->Delete();
+			const bool bWritten = ferror(file) == 0;
+			fclose(file);
+			return bWritten;
+		}
+	}
+}
@@ -14,9 +14,12 @@
 //#include "include/effects/SkColorMatrixFilter.h"
 //#include "include/core/SkMatrix44.h"
 #include "include/core/SkRegion.h"
+#include "Affine.hpp"
 #include "Stage.hpp"
 #include "Image.hpp"
 #include "RTree.h"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
 
 namespace flint
 {
@@ -27,6 +30,8 @@ namespace flint
 	const Border Border::NONE = Border(0);
 
 	static sk_sp<const GrGLInterface> Interface;
+	static thread_local std::vector<Bound>* RegionBuffer = nullptr;
+	static const unsigned int PARALLEL_GRAIN = 1024;
 
 	Renderer::Renderer() : m_pContext(nullptr),
 						   m_pCanvas(nullptr),
@@ -36,7 +41,8 @@ namespace flint
 						   m_pStage(new Stage(*this)),
 						   m_nStencilBuffer(0),
 						   m_redrawRegions(*this),
-					       m_bInvalidLayout(true)
+					       m_bInvalidLayout(true),
+						   m_nExternalMemory(0)
 	{
 	}
 
@@ -130,18 +136,46 @@ namespace flint
 
 	bool Renderer::render()
 	{
+		Stopwatch watch;
 		const Bound bound(0, 0, m_tSize.width, m_tSize.height);
 		SkPath* pPath = nullptr;
-		if(m_bInvalidLayout)
+		{
+			FLINT_TRACE_SCOPE("Stage::layout");
+			m_pStage->layout();
+		}
+		if (m_bInvalidLayout)
+		{
+			FLINT_TRACE_SCOPE("Stage::updateLayout");
 			m_pStage->updateLayout(bound, false);
-		if (!m_redrawRegions.update(pPath))
+		}
+		bool bDirty;
+		{
+			FLINT_TRACE_SCOPE("RedrawRegions::update");
+			bDirty = m_redrawRegions.update(pPath);
+		}
+		m_stats.layout += watch.lap();
+		if (!bDirty)
 			return false;
+		if (pPath)
+		{
+			m_stats.dirtyRects += (uint32_t)m_redrawRegions.getCount();
+			m_stats.dirtyArea += m_redrawRegions.getArea();
+		}
+		else
+		{
+			m_stats.dirtyRects += 1;
+			m_stats.dirtyArea += (uint64_t)m_tSize.width * m_tSize.height;
+		}
 	
-		Interface->fFunctions.fBindFramebuffer(GR_GL_DRAW_FRAMEBUFFER, m_nFBO);
+		if (m_nFBO)
+			Interface->fFunctions.fBindFramebuffer(GR_GL_DRAW_FRAMEBUFFER, m_nFBO);
 		m_pCanvas->save();
 		if (pPath)
 			m_pCanvas->clipPath(*pPath);
-		m_pStage->render(bound, m_redrawRegions);
+		{
+			FLINT_TRACE_SCOPE("Stage::render");
+			m_pStage->render(bound, m_redrawRegions);
+		}
 		/*IRenderElement* pLast = nullptr;
 		for (size_t i = 0; i < m_visibleElems.size(); ++i)
 		{
@@ -166,10 +200,44 @@ namespace flint
 			pLast = pElem;
 		}*/
 		m_pCanvas->restore();
-		flush();
-		Interface->fFunctions.fBindFramebuffer(GR_GL_DRAW_FRAMEBUFFER, 0);
-		Interface->fFunctions.fBindFramebuffer(GR_GL_READ_FRAMEBUFFER, m_nFBO);
-		Interface->fFunctions.fBlitFramebuffer(0, 0, m_tSize.width, m_tSize.height, 0, 0, m_tSize.width, m_tSize.height, GR_GL_COLOR_BUFFER_BIT, GR_GL_NEAREST);
+		m_stats.raster += watch.lap();
+		{
+			FLINT_TRACE_SCOPE("Renderer::flush");
+			flush();
+		}
+		m_stats.flush += watch.lap();
+		if (m_nFBO)
+		{
+			FLINT_TRACE_SCOPE("Renderer::blit");
+			Interface->fFunctions.fBindFramebuffer(GR_GL_DRAW_FRAMEBUFFER, 0);
+			Interface->fFunctions.fBindFramebuffer(GR_GL_READ_FRAMEBUFFER, m_nFBO);
+			Interface->fFunctions.fBlitFramebuffer(0, 0, m_tSize.width, m_tSize.height, 0, 0, m_tSize.width, m_tSize.height, GR_GL_COLOR_BUFFER_BIT, GR_GL_NEAREST);
+		}
+		m_stats.present += watch.lap();
+		return true;
+	}
+
+	void Renderer::endFrame()
+	{
+		m_lastStats = m_stats;
+		m_stats = FrameStats();
+	}
+
+	// Software surface for headless runs, no GL context or window is needed.
+	bool Renderer::createRasterContext(const Size& size)
+	{
+		if (m_pCanvas)
+			return false;
+		m_tSize = size;
+		sk_sp<SkSurface> surface = SkSurface::MakeRasterN32Premul(std::max<Size::Type>(size.width, 2), std::max<Size::Type>(size.height, 2));
+		if (!surface)
+			return false;
+		m_pCanvas = (Canvas*)surface->getCanvas();
+		surface.release();
+		m_pPaint = new Paint();
+		m_pFont = m_fontManager.getDefaultFont();
+		m_pPaint->setAntiAlias(true);
+		m_pStage->setSize(m_tSize);
 		return true;
 	}
 
@@ -177,6 +245,19 @@ namespace flint
 	{
 		if (size.width == 0 || size.height == 0)
 			m_tSize = size;
+		else if (size != m_tSize && m_nFBO == 0)
+		{
+			sk_sp<SkSurface> surface = SkSurface::MakeRasterN32Premul(size.width, size.height);
+			if (surface)
+			{
+				m_tSize = size;
+				m_pCanvas->getSurface()->unref();
+				m_pCanvas = (Canvas*)surface->getCanvas();
+				surface.release();
+				m_redrawRegions.invalidate();
+				m_pStage->setSize(m_tSize);
+			}
+		}
 		else if (size != m_tSize)
 		{
 			m_tSize = size;
@@ -201,31 +282,37 @@ namespace flint
 
 	void Renderer::setClippingRectangle(const Rectangle& rectangle)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->clipRect(SkRect::MakeXYWH((SkScalar)rectangle.position.x, (SkScalar)rectangle.position.y, (SkScalar)rectangle.size.width, (SkScalar)rectangle.size.height), true);
 	}
 
 	void Renderer::setExclusionRectangle(const Rectangle& rectangle)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->clipRect(SkRect::MakeXYWH((SkScalar)rectangle.position.x, (SkScalar)rectangle.position.y, (SkScalar)rectangle.size.width, (SkScalar)rectangle.size.height), SkClipOp::kDifference, true);
 	}
 
 	void Renderer::reset()
 	{
+		++m_stats.stateOps;
 		m_pCanvas->resetMatrix();
 	}
 
 	void Renderer::save() 
 	{
+		++m_stats.stateOps;
 		m_pCanvas->save();
 	}
 	
 	void Renderer::saveAlpha(unsigned char alpha)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->saveLayerAlpha(nullptr, alpha);
 	}
 
 	void Renderer::restore()
 	{
+		++m_stats.stateOps;
 		m_pCanvas->restore();
 	}
 
@@ -241,21 +328,42 @@ namespace flint
 
 	void Renderer::translate(const Position& position)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->translate((SkScalar)position.x, (SkScalar)position.y);
 	}
 
+	static inline SkMatrix toSkMatrix(const Affine& m)
+	{
+		return SkMatrix::MakeAll(m.a, m.c, m.tx, m.b, m.d, m.ty, 0, 0, 1);
+	}
+
+	void Renderer::transform(const Affine& matrix)
+	{
+		++m_stats.stateOps;
+		m_pCanvas->concat(toSkMatrix(matrix));
+	}
+
+	void Renderer::setTransform(const Affine& matrix)
+	{
+		++m_stats.stateOps;
+		m_pCanvas->setMatrix(toSkMatrix(matrix));
+	}
+
 	void Renderer::transform(const SkM44& matrix)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->concat(matrix);
 	}
 
 	void Renderer::setTransform(const SkM44& matrix)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->setMatrix(matrix);
 	}
 
 	void Renderer::rotate(float degree, const Position& position)
 	{
+		++m_stats.stateOps;
 		m_pCanvas->rotate(degree, (SkScalar)position.x, (SkScalar)position.y);
 	}
 
@@ -266,7 +374,63 @@ namespace flint
 
 	void Renderer::addRedrawRegion(const Bound& bound)
 	{
-		m_redrawRegions.add(bound);
+		if (RegionBuffer)
+			RegionBuffer->push_back(bound);
+		else
+			m_redrawRegions.add(bound);
+	}
+
+	void Renderer::parallel(IRenderElement* const* ppElements, size_t count, const std::function<void(IRenderElement*)>& function)
+	{
+		ThreadPool& pool = ThreadPool::Get();
+		const bool bOuter = (RegionBuffer == nullptr);
+		if (bOuter)
+		{
+			m_vecRegionBuffers.resize(pool.getThreadCount() + 1);
+			RegionBuffer = &m_vecRegionBuffers[0];
+		}
+		ThreadPool::Group group;
+		size_t begin = 0;
+		unsigned int weight = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			weight += ppElements[i]->m_nSubtreeSize;
+			if (weight >= PARALLEL_GRAIN || i + 1 == count)
+			{
+				const size_t end = i + 1;
+				pool.run(group, [this, &pool, &function, ppElements, begin, end]()
+				{
+					FLINT_TRACE_SCOPE("Renderer::parallel");
+					std::vector<Bound>* pPrevious = RegionBuffer;
+					RegionBuffer = &m_vecRegionBuffers[pool.getCurrentIndex()];
+					for (size_t j = begin; j < end; ++j)
+						function(ppElements[j]);
+					RegionBuffer = pPrevious;
+				});
+				begin = end;
+				weight = 0;
+			}
+		}
+		pool.wait(group);
+		if (bOuter)
+		{
+			RegionBuffer = nullptr;
+			for (size_t i = 0; i < m_vecRegionBuffers.size(); ++i)
+			{
+				std::vector<Bound>& buffer = m_vecRegionBuffers[i];
+				for (size_t j = 0; j < buffer.size(); ++j)
+					m_redrawRegions.add(buffer[j]);
+				buffer.clear();
+			}
+		}
+	}
+
+	// True when render() has layout or drawing to do, lets the loop skip
+	// frames without changes.
+	bool Renderer::hasDamage() const
+	{
+		const IRenderElement* pStage = m_pStage;
+		return m_bInvalidLayout || m_redrawRegions.isPending() || (pStage && (pStage->m_bInvalidLayout || pStage->m_bChildLayoutDirty));
 	}
 
 	void Renderer::invalidateLayout()
@@ -281,7 +445,9 @@ namespace flint
 
 	void Renderer::deleteLayer(void* pLayer)
 	{
-		((SkSurface*)pLayer)->unref();
+		SkSurface* pSurface = (SkSurface*)pLayer;
+		m_nExternalMemory -= (int64_t)pSurface->width() * pSurface->height() * 4;
+		pSurface->unref();
 	}
 
 	void* Renderer::createLayer(const Size& size)
@@ -290,6 +456,8 @@ namespace flint
 		const Size::Type height = size.height + 2;
 		auto info = SkImageInfo::MakeN32Premul(width, height);
 		sk_sp<SkSurface> surface = SkSurface::MakeRenderTarget((GrDirectContext*)m_pContext, SkBudgeted::kNo, info);
+		if (surface)
+			m_nExternalMemory += (int64_t)width * height * 4;
 		return surface.release();
 	}
 
@@ -308,6 +476,7 @@ namespace flint
 
 	void Renderer::drawLayer(void* pLayer)
 	{
+		++m_stats.imageDraws;
 		static const SkSamplingOptions options(SkFilterMode::kLinear, SkMipmapMode::kNone);
 		((SkSurface*)pLayer)->draw(m_pCanvas, -1, -1,  options, m_pPaint);
 	}
@@ -330,7 +499,10 @@ namespace flint
 		{
 			SkImage* pImage = SkImage::MakeFromEncoded(data).release();
 			if (pImage)
+			{
+				m_nExternalMemory += (int64_t)pImage->width() * pImage->height() * 4;
 				return new Image(pImage, *this);
+			}
 		}
 		return nullptr;
 	}
@@ -385,18 +557,21 @@ namespace flint
 
 	void Renderer::draw(const Image& image, const Rectangle& rectangle)
 	{
+		++m_stats.imageDraws;
 		const SkSamplingOptions quality(SkFilterMode::kNearest);
 		m_pCanvas->drawImageRect((const SkImage*)image.m_pImage,SkRect::MakeXYWH(0,0,rectangle.size.width, rectangle.size.height), quality, m_pPaint);
 	}
 
 	void Renderer::draw(const char* text, const Position& position)
 	{
+		++m_stats.textDraws;
 		m_pCanvas->drawString(text, position.x, position.y, *((SkFont*)m_pFont->m_pFont), *m_pPaint);
 	}
 
 	void Renderer::flush()
 	{
-		m_pContext->flush();
+		if (m_pContext)
+			m_pContext->flush();
 	}
 
 }
\ No newline at end of file
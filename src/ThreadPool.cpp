@@ -0,0 +1,137 @@
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+
+namespace flint
+{
+	static thread_local const ThreadPool* CurrentPool = nullptr;
+	static thread_local unsigned int CurrentIndex = 0;
+	// Enough to keep a disk busy, reads mostly wait.
+	static const unsigned int IO_THREADS = 2;
+
+	ThreadPool::ThreadPool(unsigned int threads) : m_vecQueues(threads + 1),
+												   m_nQueued(0),
+												   m_bQuit(false)
+	{
+		for (unsigned int i = 0; i < threads; ++i)
+			m_vecWorkers.emplace_back(&ThreadPool::work, this, i + 1);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bQuit = true;
+		}
+		m_condition.notify_all();
+		for (size_t i = 0; i < m_vecWorkers.size(); ++i)
+			m_vecWorkers[i].join();
+	}
+
+	ThreadPool& ThreadPool::Get()
+	{
+		static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+		return pool;
+	}
+
+	ThreadPool& ThreadPool::GetIO()
+	{
+		static ThreadPool pool(IO_THREADS);
+		return pool;
+	}
+
+	unsigned int ThreadPool::getCurrentIndex() const
+	{
+		return (CurrentPool == this) ? CurrentIndex : 0;
+	}
+
+	void ThreadPool::run(Group& group, Task&& task)
+	{
+		if (m_vecWorkers.empty())
+		{
+			task();
+			return;
+		}
+		group.m_nPending.fetch_add(1, std::memory_order_relaxed);
+		Queue& queue = m_vecQueues[getCurrentIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.emplace_back(&group, std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_nQueued.fetch_add(1, std::memory_order_relaxed);
+		}
+		m_condition.notify_one();
+	}
+
+	void ThreadPool::wait(Group& group)
+	{
+		std::pair<Group*, Task> task;
+		while (group.m_nPending.load(std::memory_order_acquire) != 0)
+		{
+			if (pop(getCurrentIndex(), task))
+				execute(task);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	bool ThreadPool::pop(unsigned int index, std::pair<Group*, Task>& task)
+	{
+		{
+			Queue& queue = m_vecQueues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty())
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+				m_nQueued.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		const size_t count = m_vecQueues.size();
+		for (size_t i = 1; i < count; ++i)
+		{
+			Queue& queue = m_vecQueues[(index + i) % count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty())
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+				m_nQueued.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::execute(std::pair<Group*, Task>& task)
+	{
+		task.second();
+		task.second = nullptr;
+		task.first->m_nPending.fetch_sub(1, std::memory_order_release);
+	}
+
+	void ThreadPool::work(unsigned int index)
+	{
+		CurrentPool = this;
+		CurrentIndex = index;
+		if (trace::isEnabled())
+			trace::setThreadName("Worker");
+		std::pair<Group*, Task> task;
+		while (true)
+		{
+			if (pop(index, task))
+			{
+				execute(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_bQuit || m_nQueued.load(std::memory_order_relaxed) > 0; });
+			if (m_bQuit)
+				return;
+		}
+	}
+
+}
@@ -0,0 +1,113 @@
+#include "TimerQueue.hpp"
+#include <algorithm>
+
+namespace flint
+{
+	namespace
+	{
+		// Shortest interval, a zero interval would keep the loop awake.
+		const std::chrono::milliseconds MINIMUM_INTERVAL(1);
+		// Longest delay in ms, as in browsers. Larger ones would overflow
+		// the clock.
+		const double MAXIMUM_DELAY = 2147483647.0;
+	}
+
+	TimerQueue::TimerQueue() : m_nSequence(0),
+							   m_nLastId(0)
+	{
+	}
+
+	uint32_t TimerQueue::add(double delay, bool bRepeat)
+	{
+		if (!(delay > 0.0))
+			delay = 0.0;
+		else if (delay > MAXIMUM_DELAY)
+			delay = MAXIMUM_DELAY;
+		const Clock::duration duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(delay));
+		uint32_t id = ++m_nLastId;
+		while (id == 0 || m_timers.count(id))
+			id = ++m_nLastId;
+		Timer& timer = m_timers[id];
+		timer.deadline = Clock::now() + duration;
+		timer.interval = bRepeat ? std::max<Clock::duration>(duration, MINIMUM_INTERVAL) : duration;
+		timer.bRepeat = bRepeat;
+		push(id, timer);
+		return id;
+	}
+
+	bool TimerQueue::remove(uint32_t id)
+	{
+		if (m_timers.erase(id) == 0)
+			return false;
+		if (m_heap.size() > 64 && m_heap.size() > 2 * m_timers.size())
+			compact();
+		return true;
+	}
+
+	uint32_t TimerQueue::pop(Clock::time_point now, uint64_t limit)
+	{
+		while (!m_heap.empty())
+		{
+			const Entry entry = m_heap.front();
+			if (isStale(entry))
+			{
+				std::pop_heap(m_heap.begin(), m_heap.end());
+				m_heap.pop_back();
+				continue;
+			}
+			if (entry.deadline > now || entry.sequence >= limit)
+				return 0;
+			std::pop_heap(m_heap.begin(), m_heap.end());
+			m_heap.pop_back();
+			auto itr = m_timers.find(entry.id);
+			if (itr->second.bRepeat)
+			{
+				// Late intervals skip the ticks they missed rather than
+				// firing in a burst.
+				Timer& timer = itr->second;
+				timer.deadline += timer.interval;
+				if (timer.deadline <= now)
+					timer.deadline = now + timer.interval;
+				push(entry.id, timer);
+			}
+			else
+				m_timers.erase(itr);
+			return entry.id;
+		}
+		return 0;
+	}
+
+	bool TimerQueue::getNextDeadline(Clock::time_point& deadline)
+	{
+		while (!m_heap.empty() && isStale(m_heap.front()))
+		{
+			std::pop_heap(m_heap.begin(), m_heap.end());
+			m_heap.pop_back();
+		}
+		if (m_heap.empty())
+			return false;
+		deadline = m_heap.front().deadline;
+		return true;
+	}
+
+	void TimerQueue::push(uint32_t id, Timer& timer)
+	{
+		timer.sequence = m_nSequence++;
+		const Entry entry = { timer.deadline, timer.sequence, id };
+		m_heap.push_back(entry);
+		std::push_heap(m_heap.begin(), m_heap.end());
+	}
+
+	bool TimerQueue::isStale(const Entry& entry) const
+	{
+		auto itr = m_timers.find(entry.id);
+		return itr == m_timers.end() || itr->second.sequence != entry.sequence;
+	}
+
+	void TimerQueue::compact()
+	{
+		m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(), [this](const Entry& entry) { return isStale(entry); }), m_heap.end());
+		std::make_heap(m_heap.begin(), m_heap.end());
+	}
+
+}
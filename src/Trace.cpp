@@ -0,0 +1,178 @@
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace flint
+{
+	namespace trace
+	{
+		std::atomic<bool> Enabled(false);
+
+		namespace
+		{
+			const size_t RING_SIZE = 1 << 16;
+
+			struct Event
+			{
+				const char* name;
+				uint64_t begin;
+				uint64_t duration;
+			};
+
+			struct Ring
+			{
+				explicit Ring(uint32_t id) : events(new Event[RING_SIZE]),
+											 head(0),
+											 tid(id)
+				{
+				}
+
+				std::unique_ptr<Event[]> events;
+				std::atomic<uint64_t> head;
+				uint32_t tid;
+				std::string name;
+				std::vector<std::pair<const char*, uint64_t>> stack;
+			};
+
+			std::mutex Mutex;
+			std::vector<std::unique_ptr<Ring>> Rings;
+			std::unordered_set<std::string> Names;
+			std::string Path;
+			std::chrono::steady_clock::time_point Origin;
+			thread_local Ring* CurrentRing = nullptr;
+
+			Ring& getRing()
+			{
+				if (CurrentRing == nullptr)
+				{
+					std::lock_guard<std::mutex> lock(Mutex);
+					Rings.emplace_back(new Ring((uint32_t)Rings.size() + 1));
+					CurrentRing = Rings.back().get();
+				}
+				return *CurrentRing;
+			}
+
+			void writeString(FILE* file, const char* str)
+			{
+				fputc('"', file);
+				for (; *str; ++str)
+				{
+					const unsigned char ch = (unsigned char)*str;
+					if (ch == '"' || ch == '\\')
+						fprintf(file, "\\%c", ch);
+					else if (ch < 0x20)
+						fprintf(file, "\\u%04x", ch);
+					else
+						fputc(ch, file);
+				}
+				fputc('"', file);
+			}
+		}
+
+		bool start(const char* path)
+		{
+			if (path == nullptr || *path == 0)
+				return false;
+			std::lock_guard<std::mutex> lock(Mutex);
+			Path = path;
+			// Shifted back so that now() is never zero, Scope uses zero as "not recording".
+			Origin = std::chrono::steady_clock::now() - std::chrono::nanoseconds(1);
+			for (size_t i = 0; i < Rings.size(); ++i)
+				Rings[i]->head.store(0, std::memory_order_relaxed);
+			Enabled.store(true, std::memory_order_release);
+			return true;
+		}
+
+		void stop()
+		{
+			if (!Enabled.exchange(false))
+				return;
+			std::lock_guard<std::mutex> lock(Mutex);
+			FILE* file = fopen(Path.c_str(), "wb");
+			if (file == nullptr)
+			{
+				printf("Unable to write trace file %s\n", Path.c_str());
+				return;
+			}
+			fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+			bool bFirst = true;
+			for (size_t i = 0; i < Rings.size(); ++i)
+			{
+				const Ring& ring = *Rings[i];
+				if (!ring.name.empty())
+				{
+					fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", bFirst ? "" : ",", ring.tid);
+					writeString(file, ring.name.c_str());
+					fputs("}}", file);
+					bFirst = false;
+				}
+				const uint64_t head = ring.head.load(std::memory_order_acquire);
+				for (uint64_t j = (head > RING_SIZE) ? head - RING_SIZE : 0; j < head; ++j)
+				{
+					const Event& event = ring.events[j % RING_SIZE];
+					fprintf(file, "%s\n{\"name\":", bFirst ? "" : ",");
+					writeString(file, event.name);
+					fprintf(file, ",\"cat\":\"flint\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring.tid, event.begin / 1000.0, event.duration / 1000.0);
+					bFirst = false;
+				}
+			}
+			fputs("\n]}\n", file);
+			fclose(file);
+		}
+
+		uint64_t now()
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Origin).count();
+		}
+
+		void record(const char* name, uint64_t begin, uint64_t end)
+		{
+			Ring& ring = getRing();
+			const uint64_t head = ring.head.load(std::memory_order_relaxed);
+			Event& event = ring.events[head % RING_SIZE];
+			event.name = name;
+			event.begin = begin;
+			event.duration = end - begin;
+			ring.head.store(head + 1, std::memory_order_release);
+		}
+
+		const char* intern(const char* name)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			return Names.insert(name).first->c_str();
+		}
+
+		void setThreadName(const char* name)
+		{
+			Ring& ring = getRing();
+			std::lock_guard<std::mutex> lock(Mutex);
+			ring.name = name;
+		}
+
+		void begin(const char* name)
+		{
+			if (isEnabled())
+				getRing().stack.emplace_back(name, now());
+		}
+
+		void end()
+		{
+			if (CurrentRing == nullptr)
+				return;
+			Ring& ring = *CurrentRing;
+			if (!ring.stack.empty())
+			{
+				const std::pair<const char*, uint64_t> top = ring.stack.back();
+				ring.stack.pop_back();
+				if (isEnabled())
+					record(top.first, top.second, now());
+			}
+		}
+	}
+
+}
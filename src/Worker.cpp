@@ -0,0 +1,357 @@
+#include "Worker.hpp"
+#include "libplatform/libplatform.h"
+#include "Console.hpp"
+#include "Platform.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace flint
+{
+	namespace javascript
+	{
+		namespace
+		{
+			class SerializerDelegate : public v8::ValueSerializer::Delegate
+			{
+			public:
+
+				explicit SerializerDelegate(v8::Isolate* pIsolate) : m_pIsolate(pIsolate) {}
+
+				void ThrowDataCloneError(v8::Local<v8::String> message) override
+				{
+					m_pIsolate->ThrowException(v8::Exception::Error(message));
+				}
+
+			private:
+
+				v8::Isolate* m_pIsolate;
+			};
+
+			void throwCloneError(v8::Isolate* pIsolate, const char* message)
+			{
+				pIsolate->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(pIsolate, message).ToLocalChecked()));
+			}
+
+			void reportException(v8::Isolate* pIsolate, v8::TryCatch& try_catch)
+			{
+				v8::String::Utf8Value exception(pIsolate, try_catch.Exception());
+				v8::Local<v8::Message> message = try_catch.Message();
+				char text[console::MAX_MESSAGE];
+				int length;
+				if (message.IsEmpty())
+					length = snprintf(text, sizeof(text), "Worker: %s", *exception);
+				else
+				{
+					v8::String::Utf8Value filename(pIsolate, message->GetScriptOrigin().ResourceName());
+					length = snprintf(text, sizeof(text), "Worker %s:%i: %s", *filename, message->GetLineNumber(pIsolate->GetCurrentContext()).FromMaybe(0), *exception);
+				}
+				console::write(console::Level::ERR, text, (size_t)std::max(std::min(length, (int)sizeof(text) - 1), 0));
+			}
+
+			std::string toUTF8(const std::wstring& str)
+			{
+				v8::Isolate* pIsolate = v8::Isolate::GetCurrent();
+				v8::Local<v8::String> value = v8::String::NewFromTwoByte(pIsolate, reinterpret_cast<const uint16_t*>(str.c_str()), v8::NewStringType::kNormal, (int)str.size()).ToLocalChecked();
+				v8::String::Utf8Value utf8(pIsolate, value);
+				return std::string(*utf8, utf8.length());
+			}
+		}
+
+		Worker::Worker(v8::Platform* pPlatform, const std::shared_ptr<v8::ArrayBuffer::Allocator>& pAllocator, const std::wstring& path) : m_pPlatform(pPlatform),
+																			m_pAllocator(pAllocator),
+																			m_path(path),
+																			m_pIsolate(nullptr),
+																			m_bClosed(false),
+																			m_bTerminate(false),
+																			m_bClosing(false)
+		{
+			m_thread = std::thread(&Worker::run, this);
+		}
+
+		Worker::~Worker()
+		{
+			terminate();
+		}
+
+		void Worker::postMessage(Message&& message)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_bTerminate)
+					return;
+				m_inbox.push_back(std::move(message));
+			}
+			m_condition.notify_one();
+		}
+
+		bool Worker::receive(std::deque<Message>& out)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_outbox.empty())
+				return false;
+			if (out.empty())
+				out.swap(m_outbox);
+			else
+			{
+				for (Message& message : m_outbox)
+					out.push_back(std::move(message));
+				m_outbox.clear();
+			}
+			return true;
+		}
+
+		void Worker::terminate()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bTerminate = true;
+				m_inbox.clear();
+				if (m_pIsolate)
+					m_pIsolate->TerminateExecution();
+			}
+			m_condition.notify_one();
+			if (m_thread.joinable())
+				m_thread.join();
+		}
+
+		bool Worker::serialize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, v8::Local<v8::Value> value, v8::Local<v8::Value> transfer, Message& message)
+		{
+			SerializerDelegate delegate(pIsolate);
+			v8::ValueSerializer serializer(pIsolate, &delegate);
+			std::vector<v8::Local<v8::ArrayBuffer>> vecTransfer;
+			if (!transfer.IsEmpty() && !transfer->IsUndefined())
+			{
+				if (!transfer->IsArray())
+				{
+					throwCloneError(pIsolate, "postMessage: transfer list must be an array");
+					return false;
+				}
+				v8::Local<v8::Array> array = transfer.As<v8::Array>();
+				for (uint32_t i = 0; i < array->Length(); ++i)
+				{
+					v8::Local<v8::Value> item;
+					if (!array->Get(context, i).ToLocal(&item))
+						return false;
+					if (!item->IsArrayBuffer() || !item.As<v8::ArrayBuffer>()->IsDetachable())
+					{
+						throwCloneError(pIsolate, "postMessage: only detachable ArrayBuffers can be transferred");
+						return false;
+					}
+					v8::Local<v8::ArrayBuffer> buffer = item.As<v8::ArrayBuffer>();
+					for (size_t j = 0; j < vecTransfer.size(); ++j)
+					{
+						if (vecTransfer[j] == buffer)
+						{
+							throwCloneError(pIsolate, "postMessage: ArrayBuffer listed twice in the transfer list");
+							return false;
+						}
+					}
+					serializer.TransferArrayBuffer((uint32_t)vecTransfer.size(), buffer);
+					vecTransfer.push_back(buffer);
+				}
+			}
+			serializer.WriteHeader();
+			if (!serializer.WriteValue(context, value).FromMaybe(false))
+				return false;
+			// The receiver takes the memory over, the buffers here become
+			// empty.
+			message.vecBuffers.clear();
+			for (size_t i = 0; i < vecTransfer.size(); ++i)
+			{
+				message.vecBuffers.push_back(vecTransfer[i]->GetBackingStore());
+				vecTransfer[i]->Detach();
+			}
+			std::pair<uint8_t*, size_t> data = serializer.Release();
+			message.pData.reset(data.first);
+			message.size = data.second;
+			return true;
+		}
+
+		v8::MaybeLocal<v8::Value> Worker::deserialize(v8::Isolate* pIsolate, v8::Local<v8::Context> context, Message& message)
+		{
+			v8::EscapableHandleScope scope(pIsolate);
+			v8::ValueDeserializer deserializer(pIsolate, message.pData.get(), message.size);
+			for (size_t i = 0; i < message.vecBuffers.size(); ++i)
+				deserializer.TransferArrayBuffer((uint32_t)i, v8::ArrayBuffer::New(pIsolate, message.vecBuffers[i]));
+			v8::Local<v8::Value> value;
+			if (!deserializer.ReadHeader(context).FromMaybe(false) || !deserializer.ReadValue(context).ToLocal(&value))
+				return v8::MaybeLocal<v8::Value>();
+			return scope.Escape(value);
+		}
+
+		void Worker::run()
+		{
+			trace::setThreadName("Script Worker");
+			v8::Isolate::CreateParams params;
+			params.array_buffer_allocator_shared = m_pAllocator;
+			v8::Isolate* pIsolate = v8::Isolate::New(params);
+			pIsolate->SetData(0, this);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_pIsolate = pIsolate;
+				if (m_bTerminate)
+					pIsolate->TerminateExecution();
+			}
+			{
+				v8::Isolate::Scope isolate_scope(pIsolate);
+				v8::HandleScope handle_scope(pIsolate);
+				v8::Local<v8::ObjectTemplate> global = v8::ObjectTemplate::New(pIsolate);
+				global->Set(pIsolate, "postMessage", v8::FunctionTemplate::New(pIsolate, postMessageCallback));
+				global->Set(pIsolate, "close", v8::FunctionTemplate::New(pIsolate, closeCallback));
+				global->Set(pIsolate, "print", v8::FunctionTemplate::New(pIsolate, printCallback));
+				v8::Local<v8::Context> context = v8::Context::New(pIsolate, nullptr, global);
+				v8::Context::Scope context_scope(context);
+				// close() may already have been called by the module's top
+				// level code.
+				bool bRunning = load(context) && !m_bClosing;
+				while (bRunning)
+				{
+					Message message;
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_condition.wait(lock, [this]() { return m_bTerminate || !m_inbox.empty(); });
+						if (m_bTerminate)
+							break;
+						message = std::move(m_inbox.front());
+						m_inbox.pop_front();
+					}
+					dispatch(context, message);
+					while (v8::platform::PumpMessageLoop(m_pPlatform, pIsolate))
+						continue;
+					bRunning = !m_bClosing;
+				}
+				m_vecModules.clear();
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_pIsolate = nullptr;
+			}
+			pIsolate->Dispose();
+			m_bClosed.store(true, std::memory_order_release);
+			platform::wake();
+		}
+
+		// Compiles the module and its imports, which resolve relative to the
+		// importing file, and evaluates it.
+		bool Worker::load(v8::Local<v8::Context> context)
+		{
+			v8::HandleScope scope(m_pIsolate);
+			v8::TryCatch try_catch(m_pIsolate);
+			v8::Local<v8::Module> module;
+			v8::Local<v8::Value> result;
+			const bool bLoaded = resolveModule(context, v8::String::NewFromTwoByte(m_pIsolate, reinterpret_cast<const uint16_t*>(m_path.c_str())).ToLocalChecked(), v8::Local<v8::FixedArray>(), v8::Local<v8::Module>()).ToLocal(&module) &&
+								 module->InstantiateModule(context, resolveModule).FromMaybe(false) && module->Evaluate(context).ToLocal(&result);
+			if (bLoaded && result->IsPromise() && result.As<v8::Promise>()->State() == v8::Promise::kRejected)
+			{
+				v8::String::Utf8Value error(m_pIsolate, result.As<v8::Promise>()->Result());
+				const std::string text = std::string("Worker: ") + (*error ? *error : "");
+				console::write(console::Level::ERR, text.data(), text.size());
+				return false;
+			}
+			if (!bLoaded && try_catch.HasCaught() && !try_catch.HasTerminated())
+				reportException(m_pIsolate, try_catch);
+			return bLoaded;
+		}
+
+		void Worker::dispatch(v8::Local<v8::Context> context, Message& message)
+		{
+			FLINT_TRACE_SCOPE("Worker::dispatch");
+			v8::HandleScope scope(m_pIsolate);
+			v8::TryCatch try_catch(m_pIsolate);
+			v8::Local<v8::Value> data, callback;
+			if (!deserialize(m_pIsolate, context, message).ToLocal(&data) ||
+				!context->Global()->Get(context, v8::String::NewFromUtf8Literal(m_pIsolate, "onmessage")).ToLocal(&callback))
+			{
+				if (!try_catch.HasTerminated())
+					reportException(m_pIsolate, try_catch);
+				return;
+			}
+			if (!callback->IsFunction())
+				return;
+			v8::Local<v8::Object> event = v8::Object::New(m_pIsolate);
+			event->Set(context, v8::String::NewFromUtf8Literal(m_pIsolate, "data"), data).Check();
+			v8::Local<v8::Value> args[] = { event };
+			if (callback.As<v8::Function>()->Call(context, context->Global(), 1, args).IsEmpty() && !try_catch.HasTerminated())
+				reportException(m_pIsolate, try_catch);
+			m_pIsolate->PerformMicrotaskCheckpoint();
+		}
+
+		void Worker::postMessageCallback(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			v8::Isolate* pIsolate = args.GetIsolate();
+			Worker* pWorker = reinterpret_cast<Worker*>(pIsolate->GetData(0));
+			Message message;
+			if (!serialize(pIsolate, pIsolate->GetCurrentContext(), args[0], args[1], message))
+				return;
+			{
+				std::lock_guard<std::mutex> lock(pWorker->m_mutex);
+				pWorker->m_outbox.push_back(std::move(message));
+			}
+			platform::wake();
+		}
+
+		void Worker::closeCallback(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			reinterpret_cast<Worker*>(args.GetIsolate()->GetData(0))->m_bClosing = true;
+		}
+
+		void Worker::printCallback(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			if (!console::isEnabled(console::Level::LOG))
+				return;
+			std::string text;
+			for (int i = 0; i < args.Length(); i++)
+			{
+				v8::String::Utf8Value str(args.GetIsolate(), args[i]);
+				if (i > 0)
+					text += ' ';
+				text += *str ? *str : "";
+			}
+			console::write(console::Level::LOG, text.data(), text.size());
+		}
+
+		v8::MaybeLocal<v8::Module> Worker::resolveModule(v8::Local<v8::Context> context, v8::Local<v8::String> specifier, v8::Local<v8::FixedArray> import_assertions, v8::Local<v8::Module> referrer)
+		{
+			v8::Isolate* pIsolate = context->GetIsolate();
+			Worker* pWorker = reinterpret_cast<Worker*>(pIsolate->GetData(0));
+			std::wstring directory = pWorker->m_path.substr(0, pWorker->m_path.find_last_of(L"\\/"));
+			for (size_t i = 0; !referrer.IsEmpty() && i < pWorker->m_vecModules.size(); ++i)
+			{
+				if (pWorker->m_vecModules[i].first == referrer)
+				{
+					const std::wstring& path = pWorker->m_vecModules[i].second;
+					directory = path.substr(0, path.find_last_of(L"\\/"));
+					break;
+				}
+			}
+			v8::String::Value name(pIsolate, specifier);
+			const std::wstring path = platform::resolvePath(directory.c_str(), std::wstring(reinterpret_cast<const wchar_t*>(*name), name.length()).c_str());
+			for (size_t i = 0; i < pWorker->m_vecModules.size(); ++i)
+			{
+				if (_wcsicmp(pWorker->m_vecModules[i].second.c_str(), path.c_str()) == 0)
+					return pWorker->m_vecModules[i].first.Get(pIsolate);
+			}
+			const std::string filename = toUTF8(path);
+			platform::MappedFile* pFile = platform::mapFile(path.c_str());
+			if (pFile == nullptr)
+			{
+				const std::string error = "Cannot find module " + filename;
+				pIsolate->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(pIsolate, error.c_str(), v8::NewStringType::kNormal, (int)error.size()).ToLocalChecked()));
+				return v8::MaybeLocal<v8::Module>();
+			}
+			v8::MaybeLocal<v8::String> maybeSource = v8::String::NewFromUtf8(pIsolate, pFile->data, v8::NewStringType::kNormal, (int)pFile->size);
+			platform::unmapFile(pFile);
+			v8::Local<v8::String> source;
+			if (!maybeSource.ToLocal(&source))
+				return v8::MaybeLocal<v8::Module>();
+			v8::ScriptOrigin origin(pIsolate, v8::String::NewFromUtf8(pIsolate, filename.c_str()).ToLocalChecked(), 0, 0, false, -1, v8::Local<v8::Value>(), false, false, true);
+			v8::ScriptCompiler::Source compilerSource(source, origin);
+			v8::Local<v8::Module> module;
+			if (!v8::ScriptCompiler::CompileModule(pIsolate, &compilerSource).ToLocal(&module))
+				return v8::MaybeLocal<v8::Module>();
+			pWorker->m_vecModules.emplace_back(v8::Global<v8::Module>(pIsolate, module), path);
+			return module;
+		}
+	}
+}